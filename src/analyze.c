@@ -42,61 +42,306 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_PTHREAD_H
+# include <pthread.h>
+#endif
+
+#include "error.h"
+#include "xalloc.h"
 
 #include "dhcpd-pools.h"
+#include "defaults.h"
+
+#if defined(HAVE_IMMINTRIN_H) && defined(HAVE_BUILTIN_CPU_SUPPORTS) && \
+    (defined(__x86_64__) || defined(__i386__))
+# define COUNT_X86 1
+# include <immintrin.h>
+#endif
+
+/*! \brief Scalar lease state counter.
+ * \param states Lease state column.
+ * \param n Number of states.
+ * \param count Counters indexed by lease state, that are incremented. */
+static void count_states_scalar(const unsigned char *restrict states, const size_t n,
+				size_t *restrict count)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		count[states[i]]++;
+}
+
+#ifdef COUNT_X86
+/*! \brief SSE2 lease state counter.  Every state is compared to active,
+ * free, and backup 16 states at a time, and the matches are summed to
+ * byte counters that are folded before they can overflow.
+ * \param states Lease state column.
+ * \param n Number of states.
+ * \param count Counters indexed by lease state, that are incremented. */
+__attribute__ ((__target__("sse2")))
+static void count_states_sse2(const unsigned char *restrict states, const size_t n,
+			      size_t *restrict count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i active = _mm_set1_epi8(ACTIVE);
+	const __m128i free_state = _mm_set1_epi8(FREE);
+	const __m128i backup = _mm_set1_epi8(BACKUP);
+	uint64_t lanes[2];
+	size_t i = 0, end;
+
+	while (i + 16 <= n) {
+		__m128i a = zero, f = zero, b = zero;
+
+		end = i + 255 * 16 < n ? i + 255 * 16 : n;
+		for (; i + 16 <= end; i += 16) {
+			const __m128i s = _mm_loadu_si128((const __m128i *)(states + i));
+
+			a = _mm_sub_epi8(a, _mm_cmpeq_epi8(s, active));
+			f = _mm_sub_epi8(f, _mm_cmpeq_epi8(s, free_state));
+			b = _mm_sub_epi8(b, _mm_cmpeq_epi8(s, backup));
+		}
+		_mm_storeu_si128((__m128i *)lanes, _mm_sad_epu8(a, zero));
+		count[ACTIVE] += lanes[0] + lanes[1];
+		_mm_storeu_si128((__m128i *)lanes, _mm_sad_epu8(f, zero));
+		count[FREE] += lanes[0] + lanes[1];
+		_mm_storeu_si128((__m128i *)lanes, _mm_sad_epu8(b, zero));
+		count[BACKUP] += lanes[0] + lanes[1];
+	}
+	count_states_scalar(states + i, n - i, count);
+}
+
+/*! \brief AVX2 lease state counter, see count_states_sse2().
+ * \param states Lease state column.
+ * \param n Number of states.
+ * \param count Counters indexed by lease state, that are incremented. */
+__attribute__ ((__target__("avx2")))
+static void count_states_avx2(const unsigned char *restrict states, const size_t n,
+			      size_t *restrict count)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i active = _mm256_set1_epi8(ACTIVE);
+	const __m256i free_state = _mm256_set1_epi8(FREE);
+	const __m256i backup = _mm256_set1_epi8(BACKUP);
+	uint64_t lanes[4];
+	size_t i = 0, end;
+
+	while (i + 32 <= n) {
+		__m256i a = zero, f = zero, b = zero;
+
+		end = i + 255 * 32 < n ? i + 255 * 32 : n;
+		for (; i + 32 <= end; i += 32) {
+			const __m256i s = _mm256_loadu_si256((const __m256i *)(states + i));
+
+			a = _mm256_sub_epi8(a, _mm256_cmpeq_epi8(s, active));
+			f = _mm256_sub_epi8(f, _mm256_cmpeq_epi8(s, free_state));
+			b = _mm256_sub_epi8(b, _mm256_cmpeq_epi8(s, backup));
+		}
+		_mm256_storeu_si256((__m256i *)lanes, _mm256_sad_epu8(a, zero));
+		count[ACTIVE] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+		_mm256_storeu_si256((__m256i *)lanes, _mm256_sad_epu8(f, zero));
+		count[FREE] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+		_mm256_storeu_si256((__m256i *)lanes, _mm256_sad_epu8(b, zero));
+		count[BACKUP] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+	count_states_sse2(states + i, n - i, count);
+}
+#endif				/* COUNT_X86 */
+
+static void count_states_init(const unsigned char *restrict states, const size_t n,
+			      size_t *restrict count);
+
+/*! \var count_states
+ * \brief The lease state counter selected at run time.  */
+static void (*count_states) (const unsigned char *restrict states, const size_t n,
+			     size_t *restrict count) = count_states_init;
+
+/*! \brief Select the fastest lease state counter the processor supports,
+ * and use it for this and all following calls.
+ * \param states Lease state column.
+ * \param n Number of states.
+ * \param count Counters indexed by lease state, that are incremented. */
+static void count_states_init(const unsigned char *restrict states, const size_t n,
+			      size_t *restrict count)
+{
+	count_states = count_states_scalar;
+#ifdef COUNT_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		count_states = count_states_avx2;
+	else if (__builtin_cpu_supports("sse2"))
+		count_states = count_states_sse2;
+#endif
+	count_states(states, n, count);
+}
+
+/*! \brief Count lease states of addresses from first to last.
+ * \param cols Sorted lease columns.
+ * \param first,last The addresses.
+ * \param from Index of a lease that is not after first.
+ * \param count Counters indexed by lease state, that are incremented.
+ * \param version The IP version.
+ * \return Index of the first lease after last. */
+static _DP_INLINE size_t count_span_ipv(const struct lease_columns *cols,
+					const union ipaddr_t *first, const union ipaddr_t *last,
+					size_t from, size_t *count,
+					const enum dhcp_version version)
+{
+	size_t lo = from, hi = cols->count, mid, begin;
 
-/*! \brief Prepare data for analysis. The function will sort leases and
- * ranges. */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (ip_cmp(version, &cols->ips[mid], first) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	begin = lo;
+	hi = cols->count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (ip_cmp(version, &cols->ips[mid], last) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	count_states(cols->states + begin, lo - begin, count);
+	return lo;
+}
+
+/*! \brief Count lease states of addresses from first to last, using the
+ * binary search of the IP version in use.  See count_span_ipv(). */
+static size_t count_span(const struct lease_columns *cols, const union ipaddr_t *first,
+			 const union ipaddr_t *last, size_t from, size_t *count)
+{
+	if (config.ip_version == IPv4)
+		return count_span_ipv(cols, first, last, from, count, IPv4);
+	return count_span_ipv(cols, first, last, from, count, IPv6);
+}
+
+/*! \brief Prepare data for analysis.  The function sorts ranges, and
+ * builds the range index leases are attributed with.  This is done
+ * before leases are parsed. */
 void prepare_data(void)
 {
-	/* Sort leases */
-	HASH_SORT(leases, leasecomp);
 	/* Sort ranges */
 	qsort(ranges, (size_t)num_ranges, sizeof(struct range_t), &rangecomp);
+	build_range_index();
 }
 
-/*! \brief Perform counting.  Join leases with ranges, and update counters. */
+/*! \brief Count leases of ranges.  Only the counters of the ranges are
+ * written, so parts of the ranges array can be counted in parallel.
+ * \param cols Sorted lease columns.
+ * \param begin First range.
+ * \param end End of the ranges. */
+static void count_ranges(const struct lease_columns *cols, const unsigned int begin,
+			 const unsigned int end)
+{
+	struct range_t *restrict range_p;
+	size_t count[NOSTATE + 1];
+	unsigned int i;
+
+	for (i = begin; i < end; i++) {
+		range_p = ranges + i;
+		if (range_p->states != NULL) {
+			count_range_states(range_p);
+			continue;
+		}
+		memset(count, 0, sizeof(count));
+		count_span(cols, &range_p->first_ip, &range_p->last_ip, 0, count);
+		range_p->count = count[ACTIVE];
+		range_p->touched = count[FREE];
+		range_p->backups = count[BACKUP];
+	}
+}
+
+#ifdef HAVE_PTHREAD_H
+/*! \struct count_job
+ * \brief A part of the ranges array counted by a thread.
+ */
+struct count_job {
+	pthread_t thread;
+	const struct lease_columns *cols;
+	unsigned int begin;
+	unsigned int end;
+};
+
+/*! \brief Thread start routine of the parallel range counter.
+ * \param arg The count_job to be counted.
+ * \return Always NULL. */
+static void *count_ranges_job(void *arg)
+{
+	struct count_job *job = arg;
+
+	count_ranges(job->cols, job->begin, job->end);
+	return NULL;
+}
+
+/*! \brief Count leases of ranges in config.jobs threads.  Every thread
+ * counts a contiguous part of the ranges array.
+ * \param cols Sorted lease columns. */
+static void count_ranges_parallel(const struct lease_columns *cols)
+{
+	struct count_job *jobs;
+	const unsigned int step = num_ranges / config.jobs;
+	unsigned int i;
+	int e;
+
+	jobs = xcalloc(config.jobs, sizeof(struct count_job));
+	for (i = 0; i < config.jobs; i++) {
+		jobs[i].cols = cols;
+		jobs[i].begin = i * step;
+		jobs[i].end = i + 1 < config.jobs ? (i + 1) * step : num_ranges;
+		e = pthread_create(&jobs[i].thread, NULL, count_ranges_job, &jobs[i]);
+		if (e)
+			error(EXIT_FAILURE, e, "do_counting: pthread_create");
+	}
+	for (i = 0; i < config.jobs; i++) {
+		e = pthread_join(jobs[i].thread, NULL);
+		if (e)
+			error(EXIT_FAILURE, e, "do_counting: pthread_join");
+	}
+	free(jobs);
+}
+#endif				/* HAVE_PTHREAD_H */
+
+/*! \brief Perform counting.  Leases are copied to sorted address and
+ * state columns, and the leases of each range are found with binary
+ * search and counted from the state column.  Ranges that have state
+ * bitmaps are counted from them.  With --jobs the ranges are counted in
+ * parallel, and shared networks are summed afterwards in range order so
+ * the result does not depend on the number of threads.  Leases outside
+ * of all ranges are what is left when leases in the union of ranges are
+ * taken away from all leases.  Leases are sorted afterwards only if they
+ * are printed. */
 void do_counting(void)
 {
 	struct range_t *restrict range_p;
-	const struct leases_t *restrict l = leases;
-	unsigned long i, k, block_size;
+	struct lease_columns cols;
+	union ipaddr_t span_first, span_last;
+	size_t total[NOSTATE + 1], inside[NOSTATE + 1];
+	size_t from = 0;
+	double block_size;
+	unsigned long i, k;
+	int in_span = 0;
 
+	lease_columns(&leases, &cols);
+	/* this also selects the counter before threads use it */
+	memset(total, 0, sizeof(total));
+	count_states(cols.states, cols.count, total);
+#ifdef HAVE_PTHREAD_H
+	if (1 < config.jobs && COUNT_RANGES_PER_JOB * config.jobs <= num_ranges)
+		count_ranges_parallel(&cols);
+	else
+#endif
+		count_ranges(&cols, 0, num_ranges);
 	/* Walk through ranges */
 	range_p = ranges;
 	for (i = 0; i < num_ranges; i++) {
-		while (l != NULL && ipcomp(&range_p->first_ip, &l->ip) < 0)
-			l = l->hh.prev;	/* rewind */
-		if (l == NULL)
-			l = leases;
-		for (; l != NULL && ipcomp(&l->ip, &range_p->last_ip) <= 0; l = l->hh.next) {
-			if (ipcomp(&l->ip, &range_p->first_ip) < 0)
-				continue;	/* cannot happen? */
-			/* IP in range */
-			switch (l->type) {
-			case FREE:
-				range_p->touched++;
-				break;
-			case ACTIVE:
-				range_p->count++;
-				break;
-			case BACKUP:
-				range_p->backups++;
-				break;
-			}
-			if (range_p->shared_net) {
-				switch (l->type) {
-				case FREE:
-					range_p->shared_net->touched++;
-					break;
-				case ACTIVE:
-					range_p->shared_net->used++;
-					break;
-				case BACKUP:
-					range_p->shared_net->backups++;
-					break;
-				}
-			}
+		if (range_p->shared_net) {
+			range_p->shared_net->touched += range_p->touched;
+			range_p->shared_net->used += range_p->count;
+			range_p->shared_net->backups += range_p->backups;
 		}
 		/* Size of range, shared net & all networks */
 		block_size = get_range_size(range_p);
@@ -104,6 +349,29 @@ void do_counting(void)
 			range_p->shared_net->available += block_size;
 		range_p++;
 	}
+	/* Leases outside of ranges.  The ranges are sorted, so overlapping
+	 * ranges are merged to spans in one walk. */
+	memset(inside, 0, sizeof(inside));
+	for (i = 0; i < num_ranges; i++) {
+		if (ipcomp(&ranges[i].last_ip, &ranges[i].first_ip) < 0)
+			continue;
+		if (in_span && ipcomp(&ranges[i].first_ip, &span_last) <= 0) {
+			if (0 < ipcomp(&ranges[i].last_ip, &span_last))
+				copy_ipaddr(&span_last, &ranges[i].last_ip);
+			continue;
+		}
+		if (in_span)
+			from = count_span(&cols, &span_first, &span_last, from, inside);
+		copy_ipaddr(&span_first, &ranges[i].first_ip);
+		copy_ipaddr(&span_last, &ranges[i].last_ip);
+		in_span = 1;
+	}
+	if (in_span)
+		count_span(&cols, &span_first, &span_last, from, inside);
+	outside_ranges.used = total[ACTIVE] - inside[ACTIVE];
+	outside_ranges.touched = total[FREE] - inside[FREE];
+	outside_ranges.backups = total[BACKUP] - inside[BACKUP];
+	free_lease_columns(&cols);
 	/* FIXME: During count of other shared networks default network
 	 * and all networks got mixed together semantically.  The below
 	 * fixes the problem, but is not elegant.  */
@@ -118,4 +386,6 @@ void do_counting(void)
 		shared_networks->backups += range_p->backups;
 		range_p++;
 	}
+	if (config.print_mac_addreses)
+		sort_leases(&leases);
 }
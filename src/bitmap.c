@@ -0,0 +1,217 @@
+/*
+ * The dhcpd-pools has BSD 2-clause license which also known as "Simplified
+ * BSD License" or "FreeBSD License".
+ *
+ * Copyright 2006- Sami Kerola. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the
+ *       distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR AND CONTRIBUTORS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing
+ * official policies, either expressed or implied, of Sami Kerola.
+ */
+
+/*! \file bitmap.c
+ * \brief Lease states of IPv4 ranges as two bit per address bitmaps.
+ * When lease details are not printed only the final state of addresses
+ * in the ranges matters, so the states are written straight to the
+ * bitmaps instead of the leases hash, and counted with popcount.
+ */
+
+#include <config.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xalloc.h"
+
+#include "dhcpd-pools.h"
+#include "defaults.h"
+
+/*! \def STATE_LOW_BITS
+ * \brief Low bit of every two bit state in a word. */
+#define STATE_LOW_BITS UINT64_C(0x5555555555555555)
+
+/*! \var range_states
+ * \brief Bitmaps of the ranges, indexed like the ranges array. */
+static uint64_t **range_states;
+
+/*! \brief Number of words in bitmap of a range.
+ * \param range A range.
+ * \return Number of words. */
+static size_t state_words(const struct range_t *range)
+{
+	return ((size_t)(range->last_ip.v4 - range->first_ip.v4) + 1 + 31) / 32;
+}
+
+/*! \brief Two bit code of a lease state.  Zero means no state.
+ * \param type Lease state.
+ * \return The code. */
+static inline uint64_t state_code(const enum ltype type)
+{
+	switch (type) {
+	case FREE:
+		return 1;
+	case ACTIVE:
+		return 2;
+	case BACKUP:
+		return 3;
+	case NOSTATE:
+		break;
+	}
+	return 0;
+}
+
+/*! \brief Count set bits of a word.
+ * \param x A word.
+ * \return Number of bits that are one. */
+static inline unsigned int popcount64(uint64_t x)
+{
+#ifdef HAVE_BUILTIN_POPCOUNT
+	return __builtin_popcountll(x);
+#else
+	x = x - ((x >> 1) & STATE_LOW_BITS);
+	x = (x & UINT64_C(0x3333333333333333)) + ((x >> 2) & UINT64_C(0x3333333333333333));
+	x = (x + (x >> 4)) & UINT64_C(0x0f0f0f0f0f0f0f0f);
+	return (x * UINT64_C(0x0101010101010101)) >> 56;
+#endif
+}
+
+/*! \brief Allocate state bitmaps for all ranges, if they can be used.
+ * That requires IPv4 ranges, no printing of lease details, no state
+ * file, and ranges that are not too large in total.
+ * \return Bitmaps to be given to set_range_state(), or NULL when the
+ * leases hash needs to be used. */
+uint64_t **init_range_states(void)
+{
+	double addresses = 0;
+	unsigned int i;
+
+	if (config.ip_version != IPv4 || config.print_mac_addreses || config.state_file[0]
+	    || num_ranges == 0)
+		return NULL;
+	for (i = 0; i < num_ranges; i++)
+		addresses += get_range_size(ranges + i);
+	if (MAX_STATE_ADDRESSES < addresses)
+		return NULL;
+	/* these live until exit, see clean_up() */
+	range_states = arena_alloc(sizeof(uint64_t *) * num_ranges);
+	for (i = 0; i < num_ranges; i++) {
+		range_states[i] = xcalloc(state_words(ranges + i), sizeof(uint64_t));
+		ranges[i].states = range_states[i];
+	}
+	return range_states;
+}
+
+/*! \brief Allocate empty bitmaps alike the ones init_range_states()
+ * returned, for a parser thread.
+ * \return Bitmaps to be merged with merge_range_states(). */
+uint64_t **new_range_states(void)
+{
+	uint64_t **states;
+	unsigned int i;
+
+	states = xcalloc(num_ranges, sizeof(uint64_t *));
+	for (i = 0; i < num_ranges; i++)
+		states[i] = xcalloc(state_words(ranges + i), sizeof(uint64_t));
+	return states;
+}
+
+/*! \brief Move states of a later part of lease file on top of earlier
+ * states.  An address without state in the later part keeps the state
+ * it had.
+ * \param states Bitmaps of the earlier part.
+ * \param from Bitmaps of the later part, that are freed. */
+void merge_range_states(uint64_t **states, uint64_t **from)
+{
+	uint64_t known;
+	unsigned int i;
+	size_t j, words;
+
+	for (i = 0; i < num_ranges; i++) {
+		words = state_words(ranges + i);
+		for (j = 0; j < words; j++) {
+			known = (from[i][j] | from[i][j] >> 1) & STATE_LOW_BITS;
+			known |= known << 1;
+			states[i][j] = (states[i][j] & ~known) | from[i][j];
+		}
+		free(from[i]);
+	}
+	free(from);
+}
+
+/*! \brief Save lease state of an address to bitmaps of every range it
+ * belongs to.
+ * \param states The bitmaps.
+ * \param addr Binary IP.
+ * \param type Lease state.
+ * \param replace When false an address that already has a state is
+ * left alone.
+ * \return One if the address did not have a state before, zero if it
+ * had, and -1 when the address is not in any range. */
+int set_range_state(uint64_t **states, const union ipaddr_t *addr, const enum ltype type,
+		    const int replace)
+{
+	const uint64_t code = state_code(type);
+	const unsigned int *members;
+	unsigned int n, i, shift;
+	uint64_t *word;
+	size_t offset;
+	int found = 0;
+
+	n = find_ranges_v4(addr, &members);
+	if (n == 0)
+		return -1;
+	for (i = 0; i < n; i++) {
+		offset = addr->v4 - ranges[members[i]].first_ip.v4;
+		word = states[members[i]] + offset / 32;
+		shift = (offset % 32) * 2;
+		if ((*word >> shift) & 3) {
+			if (!replace)
+				continue;
+		} else
+			found = 1;
+		*word = (*word & ~(UINT64_C(3) << shift)) | code << shift;
+	}
+	return found;
+}
+
+/*! \brief Count lease states of a range from its bitmap.
+ * \param range The range, that must have a bitmap. */
+void count_range_states(struct range_t *range)
+{
+	const size_t words = state_words(range);
+	uint64_t lo, hi;
+	size_t i;
+
+	for (i = 0; i < words; i++) {
+		lo = range->states[i] & STATE_LOW_BITS;
+		hi = (range->states[i] >> 1) & STATE_LOW_BITS;
+		range->touched += popcount64(lo & ~hi);
+		range->count += popcount64(hi & ~lo);
+		range->backups += popcount64(lo & hi);
+	}
+}
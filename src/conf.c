@@ -0,0 +1,753 @@
+/*
+ * The dhcpd-pools has BSD 2-clause license which also known as "Simplified
+ * BSD License" or "FreeBSD License".
+ *
+ * Copyright 2006- Sami Kerola. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the
+ *       distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR AND CONTRIBUTORS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing
+ * official policies, either expressed or implied, of Sami Kerola.
+ */
+
+/*! \file conf.c
+ * \brief The dhcpd.conf file parser.  The file is mapped to memory, or
+ * read to a buffer, and split to words, quoted strings, semicolons and
+ * braces.  The first word of a statement is compared to the keywords
+ * the parser is interested about, and the rest of the words are given
+ * meaning by the keyword.  Each file is parsed to a configuration
+ * record, and the records are replayed to ranges and shared networks.
+ * With --jobs the include files are parsed in threads.
+ */
+
+#include <config.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+# include <pthread.h>
+#endif
+
+#include "error.h"
+#include "xalloc.h"
+
+#include "dhcpd-pools.h"
+#include "defaults.h"
+
+/*! \enum conf_token
+ * \brief Tokens of the dhcpd.conf file.
+ */
+enum conf_token {
+	TOKEN_END,
+	TOKEN_WORD,
+	TOKEN_SEMICOLON,
+	TOKEN_OPEN_BRACE,
+	TOKEN_CLOSE_BRACE
+};
+
+/*! \struct conf_lexer
+ * \brief State of the dhcpd.conf tokenizer.
+ */
+struct conf_lexer {
+	const char *p;
+	const char *end;
+	char *word;
+	size_t len;
+	unsigned int too_long:1;
+};
+
+/*! \var word_end
+ * \brief Characters that end a word, unless they are quoted.  Quote
+ * marks are removed from words. */
+static const unsigned char word_end[256] = {
+	['\t'] = 1, ['\n'] = 1, ['\v'] = 1, ['\f'] = 1, ['\r'] = 1, [' '] = 1,
+	[';'] = 1, ['{'] = 1, ['}'] = 1, ['#'] = 1, ['"'] = 2
+};
+
+/*! \brief Read next token from the dhcpd.conf file.  Comments and white
+ * space between tokens are skipped.
+ * \param lx The tokenizer state.  When a word is returned it is in
+ * lx->word, that is NUL terminated. */
+static enum conf_token next_conf_token(struct conf_lexer *restrict lx)
+{
+	const char *p = lx->p, *end = lx->end;
+	int quote = 0;
+
+	while (p < end) {
+		if (*p == '#') {
+			p = memchr(p, '\n', end - p);
+			if (p == NULL)
+				p = end;
+		} else if (isspace((unsigned char)*p))
+			p++;
+		else
+			break;
+	}
+	lx->p = p + 1;
+	if (p == end) {
+		lx->p = end;
+		return TOKEN_END;
+	}
+	switch (*p) {
+	case ';':
+		return TOKEN_SEMICOLON;
+	case '{':
+		return TOKEN_OPEN_BRACE;
+	case '}':
+		return TOKEN_CLOSE_BRACE;
+	}
+	lx->len = 0;
+	lx->too_long = 0;
+	for (; p < end; p++) {
+		const unsigned char c = *p;
+
+		if (word_end[c] == 2) {
+			quote = !quote;
+			continue;
+		}
+		if (word_end[c] && !quote)
+			break;
+		if (lx->len < MAXLEN - 1)
+			lx->word[lx->len++] = c;
+		else
+			lx->too_long = 1;
+	}
+	lx->word[lx->len] = '\0';
+	lx->p = p;
+	return TOKEN_WORD;
+}
+
+/*! \brief Keyword search in dhcpd.conf file.  Only the first word of a
+ * statement is a keyword, and it must match exactly.
+ * \param word The word.
+ * \param len Length of the word.
+ * \return Indicator what configuration was found. */
+static enum isc_conf_parser conf_keyword(const char *restrict word, const size_t len)
+{
+	switch (len) {
+	case 5:
+		if (!memcmp(word, "range", 5))
+			return ITS_A_RANGE;
+		break;
+	case 6:
+		if (!memcmp(word, "range6", 6))
+			return ITS_A_RANGE;
+		if (config.all_as_shared && !memcmp(word, "subnet", 6))
+			return ITS_A_SUBNET;
+		break;
+	case 7:
+		if (!memcmp(word, "include", 7))
+			return ITS_AN_INCLUDE;
+		if (config.all_as_shared && !memcmp(word, "subnet6", 7))
+			return ITS_A_SUBNET;
+		break;
+	case 14:
+		if (!memcmp(word, "shared-network", 14))
+			return ITS_A_SHAREDNET;
+		break;
+	}
+	return ITS_NOTHING_INTERESTING;
+}
+
+/*! \struct shared_name
+ * \brief Interned shared network name.
+ */
+struct shared_name {
+	char *name;
+	unsigned int id;
+	UT_hash_handle hh;
+};
+
+/*! \var shared_names
+ * \brief Hash of the shared network names. */
+static struct shared_name *shared_names;
+
+/*! \var first_range_version
+ * \brief IP version of the first range in dhcpd.conf. */
+static int first_range_version;
+
+/*! \brief Add a range to ranges array.
+ * \param first First address of the range.
+ * \param last Last address of the range.
+ * \param shared_p The shared network of the range. */
+static void add_range(const union ipaddr_t *restrict first, const union ipaddr_t *restrict last,
+		      struct shared_network_t *restrict shared_p)
+{
+	struct range_t *range_p = ranges + num_ranges;
+
+	copy_ipaddr(&range_p->first_ip, first);
+	copy_ipaddr(&range_p->last_ip, last);
+	range_p->count = 0;
+	range_p->touched = 0;
+	range_p->backups = 0;
+	range_p->states = NULL;
+	range_p->shared_net = shared_p;
+	num_ranges++;
+	if (RANGES < num_ranges + 1) {
+		RANGES *= 2;
+		ranges = xrealloc(ranges, sizeof(struct range_t) * RANGES);
+	}
+}
+
+/*! \brief Set name of a shared network.  Each name is stored once, and
+ * networks with the same name get the same name_id.
+ * \param shared_p The shared network.
+ * \param name The name. */
+static void set_shared_network_name(struct shared_network_t *restrict shared_p,
+				    const char *restrict name)
+{
+	struct shared_name *n;
+	const size_t len = strlen(name);
+
+	HASH_FIND(hh, shared_names, name, len, n);
+	if (n == NULL) {
+		n = arena_alloc(sizeof(struct shared_name));
+		n->name = arena_strdup(name);
+		n->id = HASH_COUNT(shared_names);
+		HASH_ADD_KEYPTR(hh, shared_names, n->name, len, n);
+	}
+	shared_p->name = n->name;
+	shared_p->name_id = n->id;
+}
+
+/*! \brief Compare shared network names for HASH_SORT. */
+static int shared_name_cmp(const struct shared_name *a, const struct shared_name *b)
+{
+	return strcmp(a->name, b->name);
+}
+
+/*! \brief Renumber name_id of the shared networks in the order of the
+ * names, so that sorting by name can compare the numbers.  The names are
+ * compared once each, instead of every time two ranges are compared. */
+void rank_shared_network_names(void)
+{
+	struct shared_name *n, *tmp;
+	unsigned int *rank, i = 0;
+
+	rank = xmalloc(sizeof(unsigned int) * (HASH_COUNT(shared_names) + 1));
+	HASH_SORT(shared_names, shared_name_cmp);
+	HASH_ITER(hh, shared_names, n, tmp) {
+		rank[n->id] = i;
+		n->id = i++;
+	}
+	for (i = 0; i <= num_shared_networks; i++)
+		shared_networks[i].name_id = rank[shared_networks[i].name_id];
+	free(rank);
+}
+
+/*! \brief Double the size of shared networks array.  The shared network
+ * pointers of ranges are moved to the new array.
+ */
+static void grow_shared_networks(void)
+{
+	struct shared_network_t *old = shared_networks;
+	unsigned int i;
+
+	SHARED_NETWORKS *= 2;
+	shared_networks = xmalloc(sizeof(struct shared_network_t) * SHARED_NETWORKS);
+	memcpy(shared_networks, old, sizeof(struct shared_network_t) * num_shared_networks);
+	for (i = 0; i < num_ranges; i++)
+		ranges[i].shared_net = shared_networks + (ranges[i].shared_net - old);
+	free(old);
+}
+
+/*! \brief Add a shared network.  The shared networks array may move, so
+ * pointers to it are not valid after this.
+ * \param name Name of the network.
+ * \param netmask Prefix length of a subnet, -1 when a subnet has no
+ * netmask, and 0 for a shared network.
+ * \return The shared network. */
+static struct shared_network_t *add_shared_network(const char *restrict name,
+						   const int netmask)
+{
+	struct shared_network_t *shared_p;
+
+	num_shared_networks++;
+	if (SHARED_NETWORKS < num_shared_networks + 2)
+		grow_shared_networks();
+	shared_p = shared_networks + num_shared_networks;
+	set_shared_network_name(shared_p, name);
+	shared_p->available = 0;
+	shared_p->used = 0;
+	shared_p->touched = 0;
+	shared_p->backups = 0;
+	shared_p->netmask = netmask;
+	return shared_p;
+}
+
+/*! \brief Append prefix length of a subnet netmask to the subnet name.
+ * \param name Name of the subnet, in a MAXLEN buffer.
+ * \param netmask The prefix length, that is -1 until it is set.
+ * \param word The netmask. */
+static void set_netmask(char *restrict name, int *restrict netmask, const char *restrict word)
+{
+	const size_t len = strlen(name);
+	union ipaddr_t addr;
+
+	if (*netmask != -1 || parse_ipaddr_any(word, strlen(word), &addr) != IPv4)
+		return;
+	for (*netmask = 32; 0 < *netmask && (addr.v4 & 0x01) == 0; (*netmask)--)
+		addr.v4 >>= 1;
+	snprintf(name + len, MAXLEN - len, "/%d", *netmask);
+}
+
+/*! \brief Map, or read, dhcpd.conf file to memory.
+ * \param config_file Path of the file.
+ * \param st Output of the file status.
+ * \param size Output of the file size.
+ * \param mapped Output that is true when the file was mapped.
+ * \return The file contents. */
+static char *load_conf_file(const char *restrict config_file, struct stat *restrict st,
+			    size_t *size, int *mapped)
+{
+	size_t have = 0, alloc;
+	ssize_t len;
+	char *buf;
+	int fd;
+
+	fd = open(config_file, O_RDONLY);
+	if (fd < 0)
+		error(EXIT_FAILURE, errno, "parse_config: %s", config_file);
+	if (fstat(fd, st))
+		error(EXIT_FAILURE, errno, "parse_config: fstat %s", config_file);
+	*mapped = 0;
+#ifdef HAVE_MMAP
+	if (S_ISREG(st->st_mode) && 0 < st->st_size) {
+		buf = mmap(NULL, st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (buf != MAP_FAILED) {
+			close(fd);
+			*size = st->st_size;
+			*mapped = 1;
+			return buf;
+		}
+	}
+#endif
+	alloc = S_ISREG(st->st_mode) && 0 < st->st_size ? (size_t)st->st_size + 1 : MAXLEN;
+	buf = xmalloc(alloc);
+	while ((len = read(fd, buf + have, alloc - have)) != 0) {
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			error(EXIT_FAILURE, errno, "parse_config: %s", config_file);
+		}
+		have += len;
+		if (have == alloc) {
+			alloc *= 2;
+			buf = xrealloc(buf, alloc);
+		}
+	}
+	close(fd);
+	*size = have;
+	return buf;
+}
+
+/*! \brief The dhcpd.conf file parser.  Statements that are not ranges,
+ * shared networks, or includes are skipped, and so are subnets unless
+ * they are wanted as shared networks.  The file is parsed to a
+ * configuration record without touching the ranges and shared networks,
+ * so that many files can be parsed at the same time.
+ * \param config_file Path of the file.
+ * \param inherited_all True when ranges that are not in a shared network
+ * of this file belong to "All networks", see find_conf_record().
+ * \return Configuration record of the file.
+ */
+static struct conf_record *parse_conf_file(const char *restrict config_file,
+					   const int inherited_all)
+{
+	struct conf_lexer lx;
+	struct conf_record *rec;
+	struct conf_entry *entry;
+	struct stat st;
+	enum conf_token tok;
+	enum isc_conf_parser clause = ITS_NOTHING_INTERESTING;
+	unsigned int words = 0, num_ips = 0, depth = 0, shared_depth = UINT_MAX;
+	unsigned int local_nets = 0, new_net = 0, shared_ref = CONF_NET_INHERITED;
+	int version = IPvUNKNOWN, netmask = 0;
+	union ipaddr_t ip[2];
+	char *buf, *name;
+	size_t size;
+	int mapped;
+
+	buf = load_conf_file(config_file, &st, &size, &mapped);
+	rec = new_conf_record(config_file, &st, inherited_all);
+	lx.p = buf;
+	lx.end = buf + size;
+	lx.word = xmalloc(MAXLEN);
+	name = xmalloc(MAXLEN);
+	do {
+		tok = next_conf_token(&lx);
+		if (tok == TOKEN_WORD) {
+			if (words++ == 0) {
+				clause = lx.too_long ? ITS_NOTHING_INTERESTING
+				    : conf_keyword(lx.word, lx.len);
+				num_ips = 0;
+				memset(ip, 0, sizeof(ip));
+				continue;
+			}
+			switch (clause) {
+			case ITS_A_RANGE:
+				/* words like dynamic-bootp are not addresses, and
+				 * the last address is of the same IP version as
+				 * the first */
+				if (num_ips == 0) {
+					version = parse_ipaddr_any(lx.word, lx.len, &ip[0]);
+					if (version != IPvUNKNOWN)
+						num_ips++;
+				} else if (num_ips == 1
+					   && parse_ipaddr_any(lx.word, lx.len, &ip[1]) == version)
+					num_ips++;
+				break;
+			case ITS_A_SHAREDNET:
+				memcpy(name, lx.word, lx.len + 1);
+				netmask = 0;
+				shared_depth = depth;
+				shared_ref = CONF_NET_LOCAL(local_nets++);
+				new_net = 1;
+				clause = ITS_NOTHING_INTERESTING;
+				break;
+			case ITS_A_SUBNET:
+				if (words == 2) {
+					/* ignore subnets inside a shared-network */
+					if (shared_ref != CONF_NET_ALL
+					    && (shared_ref != CONF_NET_INHERITED || !inherited_all)) {
+						clause = ITS_NOTHING_INTERESTING;
+						break;
+					}
+					memcpy(name, lx.word, lx.len + 1);
+					/* subnet names get the netmask appended */
+					netmask = -1;
+					shared_depth = depth;
+					shared_ref = CONF_NET_LOCAL(local_nets++);
+					new_net = 1;
+				} else if (!strcmp(lx.word, "netmask"))
+					clause = ITS_A_NETMASK;
+				break;
+			case ITS_A_NETMASK:
+				set_netmask(name, &netmask, lx.word);
+				clause = ITS_NOTHING_INTERESTING;
+				break;
+			case ITS_AN_INCLUDE:
+				entry = add_conf_entry(rec, CONF_INCLUDE, lx.word);
+				entry->net = shared_ref;
+				clause = ITS_NOTHING_INTERESTING;
+				break;
+			default:
+				/* do nothing */ ;
+			}
+			continue;
+		}
+		/* end of statement */
+		if (clause == ITS_A_RANGE && 0 < num_ips) {
+			entry = add_conf_entry(rec, CONF_RANGE, NULL);
+			entry->net = shared_ref;
+			entry->arg = version;
+			/* flip first and last if they are in unusual order */
+			if (0 < ip_cmp(version, &ip[0], &ip[num_ips - 1])) {
+				entry->first_ip = ip[num_ips - 1];
+				entry->last_ip = ip[0];
+			} else {
+				entry->first_ip = ip[0];
+				entry->last_ip = ip[num_ips - 1];
+			}
+		}
+		if (new_net) {
+			entry = add_conf_entry(rec, CONF_SHARED_NET, name);
+			entry->arg = netmask;
+		}
+		new_net = 0;
+		clause = ITS_NOTHING_INTERESTING;
+		words = 0;
+		if (tok == TOKEN_OPEN_BRACE)
+			depth++;
+		else if (tok == TOKEN_CLOSE_BRACE && 0 < depth) {
+			depth--;
+			/* end of shared-network */
+			if (depth == shared_depth) {
+				shared_depth = UINT_MAX;
+				shared_ref = CONF_NET_ALL;
+			}
+		}
+	} while (tok != TOKEN_END);
+	free(name);
+	free(lx.word);
+#ifdef HAVE_MMAP
+	if (mapped) {
+		munmap(buf, size);
+		return rec;
+	}
+#endif
+	free(buf);
+	return rec;
+}
+
+/*! \brief Map network reference of a configuration record entry to
+ * inherited_all of an include file, see find_conf_record().
+ * \param net The reference.
+ * \param inherited_all The value of the file that has the entry.
+ * \return True when the include file ranges belong to "All networks". */
+static inline int include_inherits_all(const uint32_t net, const int inherited_all)
+{
+	if (net == CONF_NET_ALL)
+		return 1;
+	if (net == CONF_NET_INHERITED)
+		return inherited_all;
+	return 0;
+}
+
+static void visit_conf_file(const char *restrict config_file, const unsigned int inherited);
+
+/*! \brief Add the ranges and shared networks of a configuration record
+ * to the ranges and shared networks arrays, and visit include files at
+ * the place of the include statement.
+ * \param rec Configuration record of the file.
+ * \param inherited Index of the shared network ranges belong to, when
+ * they are not in a shared network of this file.
+ */
+static void replay_conf_record(const struct conf_record *restrict rec,
+			       const unsigned int inherited)
+{
+	const struct conf_entry *entry;
+	struct shared_network_t *shared_p;
+	unsigned int *local, num_local = 0, net;
+	uint32_t i;
+
+	local = xmalloc(sizeof(unsigned int) * (rec->num_entries + 1));
+	for (i = 0; i < rec->num_entries; i++) {
+		entry = rec->entries + i;
+		if (entry->type == CONF_SHARED_NET) {
+			shared_p = add_shared_network(rec->strings + entry->str, entry->arg);
+			local[num_local++] = shared_p - shared_networks;
+			continue;
+		}
+		if (entry->net == CONF_NET_ALL)
+			net = 0;
+		else if (entry->net == CONF_NET_INHERITED)
+			net = inherited;
+		else
+			/* conf_record_is_sane() has checked the reference */
+			net = local[entry->net - CONF_NET_LOCAL(0)];
+		if (entry->type == CONF_INCLUDE) {
+			visit_conf_file(rec->strings + entry->str, net);
+			continue;
+		}
+		/* the first range decides IP version of the configuration */
+		if (first_range_version == IPvUNKNOWN)
+			first_range_version = entry->arg;
+		if (config.ip_version == IPvUNKNOWN)
+			set_ipv_functions(entry->arg);
+		else if (entry->arg != (int32_t)config.ip_version)
+			continue;
+		add_range(&entry->first_ip, &entry->last_ip, shared_networks + net);
+	}
+	free(local);
+}
+
+/*! \brief Get ranges and shared networks of a configuration file either
+ * from a configuration record, or by parsing the file.
+ * \param config_file Path of the file.
+ * \param inherited Index of the shared network ranges belong to, when
+ * they are not in a shared network of this file.
+ */
+static void visit_conf_file(const char *restrict config_file, const unsigned int inherited)
+{
+	const int inherited_all = inherited == 0;
+	struct conf_record *rec;
+
+	rec = find_conf_record(config_file, inherited_all);
+	if (rec == NULL) {
+		rec = parse_conf_file(config_file, inherited_all);
+		add_conf_record(rec);
+	}
+	replay_conf_record(rec, inherited);
+}
+
+#ifdef HAVE_PTHREAD_H
+/*! \struct conf_job
+ * \brief A configuration file, and its record once it is parsed.
+ */
+struct conf_job {
+	const char *path;
+	int inherited_all;
+	struct conf_record *rec;
+	unsigned int parse:1;
+};
+
+/*! \struct conf_pool
+ * \brief Configuration files worker threads take to parse.
+ */
+struct conf_pool {
+	pthread_mutex_t lock;
+	struct conf_job *jobs;
+	unsigned int next;
+	unsigned int end;
+};
+
+/*! \brief Worker thread that parses configuration files of the pool
+ * until there are none left.
+ * \param arg The conf_pool.
+ * \return NULL. */
+static void *parse_conf_jobs(void *arg)
+{
+	struct conf_pool *pool = arg;
+	struct conf_job *job;
+
+	while (1) {
+		pthread_mutex_lock(&pool->lock);
+		job = pool->next < pool->end ? pool->jobs + pool->next++ : NULL;
+		pthread_mutex_unlock(&pool->lock);
+		if (job == NULL)
+			return NULL;
+		if (job->parse)
+			job->rec = parse_conf_file(job->path, job->inherited_all);
+	}
+}
+
+/*! \brief Parse dhcpd.conf and the files it includes in config.jobs
+ * threads.  The include statements are followed level by level, and the
+ * files of a level are parsed at the same time.  The records are kept,
+ * so that visit_conf_file() finds them and adds the ranges and shared
+ * networks in the order a serial parse would.
+ * \param config_file Path of the file.
+ * \param inherited_all See find_conf_record().
+ */
+static void parse_conf_files(const char *restrict config_file, const int inherited_all)
+{
+	struct conf_pool pool;
+	struct conf_job *jobs;
+	const struct conf_entry *entry;
+	pthread_t *threads;
+	unsigned int num_jobs = 1, jobs_size = 16, begin = 0, num_parse, num_threads;
+	unsigned int i, j;
+	uint32_t k;
+	int e, inh;
+
+	jobs = xcalloc(jobs_size, sizeof(struct conf_job));
+	jobs[0].path = config_file;
+	jobs[0].inherited_all = inherited_all;
+	threads = xmalloc(sizeof(pthread_t) * config.jobs);
+	pthread_mutex_init(&pool.lock, NULL);
+	while (begin < num_jobs) {
+		num_parse = 0;
+		for (i = begin; i < num_jobs; i++) {
+			jobs[i].rec = find_conf_record(jobs[i].path, jobs[i].inherited_all);
+			jobs[i].parse = jobs[i].rec == NULL;
+			num_parse += jobs[i].parse;
+		}
+		pool.jobs = jobs;
+		pool.next = begin;
+		pool.end = num_jobs;
+		num_threads = num_parse < config.jobs ? num_parse : config.jobs;
+		if (num_threads < 2)
+			parse_conf_jobs(&pool);
+		else {
+			for (i = 0; i < num_threads; i++) {
+				e = pthread_create(&threads[i], NULL, parse_conf_jobs, &pool);
+				if (e)
+					error(EXIT_FAILURE, e, "parse_config: pthread_create");
+			}
+			for (i = 0; i < num_threads; i++) {
+				e = pthread_join(threads[i], NULL);
+				if (e)
+					error(EXIT_FAILURE, e, "parse_config: pthread_join");
+			}
+		}
+		/* the files included by this level are the next level */
+		for (i = begin, begin = num_jobs; i < begin; i++) {
+			if (jobs[i].parse)
+				add_conf_record(jobs[i].rec);
+			for (k = 0; k < jobs[i].rec->num_entries; k++) {
+				entry = jobs[i].rec->entries + k;
+				if (entry->type != CONF_INCLUDE)
+					continue;
+				inh = include_inherits_all(entry->net, jobs[i].inherited_all);
+				for (j = 0; j < num_jobs; j++)
+					if (jobs[j].inherited_all == inh
+					    && !strcmp(jobs[j].path, jobs[i].rec->strings + entry->str))
+						break;
+				if (j < num_jobs)
+					continue;
+				if (num_jobs == jobs_size) {
+					jobs_size *= 2;
+					jobs = xrealloc(jobs, sizeof(struct conf_job) * jobs_size);
+				}
+				jobs[num_jobs].path = jobs[i].rec->strings + entry->str;
+				jobs[num_jobs].inherited_all = inh;
+				num_jobs++;
+			}
+		}
+	}
+	pthread_mutex_destroy(&pool.lock);
+	free(threads);
+	free(jobs);
+}
+#endif				/* HAVE_PTHREAD_H */
+
+/*! \brief Forget the ranges, shared networks and shared network names
+ * added so far, so that dhcpd.conf can be parsed again. */
+void reset_config(void)
+{
+	num_ranges = num_shared_networks = 0;
+	HASH_CLEAR(hh, shared_names);
+}
+
+/*! \brief Read dhcpd.conf file and the files it includes.
+ * \param is_include False when the file is included from another one.
+ * \param config_file Path of the file.
+ * \param shared_p The shared network ranges belong to, when they are not
+ * in a shared network.
+ * \return IP version of the first range, or IPvUNKNOWN if there are no
+ * ranges.  When the IP version is set before the call, ranges of the
+ * other version are skipped.
+ */
+int parse_config(int is_include, const char *restrict config_file,
+		 struct shared_network_t *restrict shared_p)
+{
+	if (is_include)
+		/* Default place holder for ranges "All networks". */
+		set_shared_network_name(shared_p, shared_networks->name);
+	first_range_version = IPvUNKNOWN;
+	if (config.config_cache[0])
+		load_config_cache();
+#ifdef HAVE_PTHREAD_H
+	if (1 < config.jobs)
+		parse_conf_files(config_file, shared_p == shared_networks);
+#endif
+	visit_conf_file(config_file, shared_p - shared_networks);
+	if (config.config_cache[0])
+		save_config_cache();
+	return first_range_version;
+}
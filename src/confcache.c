@@ -0,0 +1,467 @@
+/*
+ * The dhcpd-pools has BSD 2-clause license which also known as "Simplified
+ * BSD License" or "FreeBSD License".
+ *
+ * Copyright 2006- Sami Kerola. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the
+ *       distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR AND CONTRIBUTORS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing
+ * official policies, either expressed or implied, of Sami Kerola.
+ */
+
+/*! \file confcache.c
+ * \brief Configuration records and cache.  Parsing a dhcpd.conf file,
+ * or an include file, results in a record of the ranges, shared networks
+ * and include statements of the file.  The records are kept for the run,
+ * and with --config-cache they are saved together with identity of the
+ * files.  The next run replays the files that have not changed, and
+ * parses only the ones that have.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "close-stream.h"
+#include "error.h"
+#include "xalloc.h"
+
+#include "dhcpd-pools.h"
+#include "defaults.h"
+
+/*! \def CONF_CACHE_MAGIC
+ * \brief Identifier and format version of a configuration cache.  */
+#define CONF_CACHE_MAGIC "dpconf02"
+
+/*! \def CONF_STAT_MTIME
+ * \brief Modification time of a file in nanoseconds, so that a file
+ * that is changed within the same second it was cached is noticed.
+ * Whole seconds when the system does not tell nanoseconds, and then
+ * files modified during the second the cache is written are not reused. */
+/*! \def CONF_STAT_CTIME
+ * \brief Status change time of a file, see CONF_STAT_MTIME. */
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+# define CONF_STAT_MTIME(st) \
+	((uint64_t)(st)->st_mtim.tv_sec * 1000000000 + (uint64_t)(st)->st_mtim.tv_nsec)
+# define CONF_STAT_CTIME(st) \
+	((uint64_t)(st)->st_ctim.tv_sec * 1000000000 + (uint64_t)(st)->st_ctim.tv_nsec)
+#else
+# define CONF_STAT_MTIME(st) ((uint64_t)(st)->st_mtime)
+# define CONF_STAT_CTIME(st) ((uint64_t)(st)->st_ctime)
+#endif
+
+/*! \struct conf_cache_header
+ * \brief Beginning of a configuration cache file, that is followed by
+ * num_records conf_cache_record structures.  The checksum covers
+ * everything after the header.
+ */
+struct conf_cache_header {
+	char magic[8];
+	uint32_t all_as_shared;
+	uint32_t num_records;
+	uint64_t checksum;
+};
+
+/*! \struct conf_cache_record
+ * \brief A configuration file in the cache.  The record is followed by
+ * path_len bytes of path, num_entries conf_entry structures, and
+ * strings_len bytes of strings.
+ */
+struct conf_cache_record {
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	uint64_t mtime;
+	uint64_t ctime;
+	uint32_t inherited_all;
+	uint32_t path_len;
+	uint32_t num_entries;
+	uint32_t strings_len;
+};
+
+/*! \var conf_records
+ * \brief Configuration files of the cache, and the ones parsed in this
+ * run. */
+static struct conf_record **conf_records;
+
+/*! \var num_conf_records
+ * \brief Number of conf_records. */
+static unsigned int num_conf_records;
+
+/*! \var conf_records_size
+ * \brief Allocated size of conf_records. */
+static unsigned int conf_records_size;
+
+/*! \var conf_cache_changed
+ * \brief A file was parsed, so the cache needs to be saved. */
+static int conf_cache_changed;
+
+/*! \var conf_cache_loaded
+ * \brief The cache has been read, and is not read again when dhcpd.conf
+ * is parsed again. */
+static int conf_cache_loaded;
+
+/*! \brief Update FNV-1a checksum of configuration cache.
+ * \param sum The checksum so far.
+ * \param p Data to be added.
+ * \param len Length of the data.
+ * \return The new checksum. */
+static uint64_t conf_cache_checksum(uint64_t sum, const void *p, size_t len)
+{
+	const unsigned char *c = p;
+
+	while (len--) {
+		sum ^= *c++;
+		sum *= UINT64_C(0x100000001b3);
+	}
+	return sum;
+}
+
+/*! \def CONF_CACHE_CHECKSUM_INIT
+ * \brief Initial value of conf_cache_checksum().  */
+#define CONF_CACHE_CHECKSUM_INIT UINT64_C(0xcbf29ce484222325)
+
+/*! \brief Write data to configuration cache, and add it to checksum.
+ * \param f The cache file.
+ * \param p The data.
+ * \param len Length of the data.
+ * \param sum The checksum, that is updated. */
+static void write_conf_cache(FILE *f, const void *p, size_t len, uint64_t *sum)
+{
+	if (len == 0)
+		return;
+	fwrite(p, len, 1, f);
+	*sum = conf_cache_checksum(*sum, p, len);
+}
+
+/*! \brief Append a record to conf_records.
+ * \param rec The record. */
+static void append_conf_record(struct conf_record *rec)
+{
+	if (num_conf_records == conf_records_size) {
+		conf_records_size = conf_records_size ? conf_records_size * 2 : 16;
+		conf_records = xrealloc(conf_records,
+					sizeof(struct conf_record *) * conf_records_size);
+	}
+	conf_records[num_conf_records++] = rec;
+}
+
+/*! \brief Forget all configuration records. */
+static void free_conf_records(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_conf_records; i++) {
+		free(conf_records[i]->path);
+		free(conf_records[i]->entries);
+		free(conf_records[i]->strings);
+		free(conf_records[i]);
+	}
+	num_conf_records = 0;
+}
+
+/*! \brief Check configuration record entries refer to its strings, and
+ * to shared networks that are defined before them.
+ * \param rec The record.
+ * \return True if the record is sane. */
+static int conf_record_is_sane(const struct conf_record *rec)
+{
+	uint32_t i, num_local = 0;
+
+	if (rec->strings_len && rec->strings[rec->strings_len - 1] != '\0')
+		return 0;
+	for (i = 0; i < rec->num_entries; i++) {
+		if (CONF_INCLUDE < rec->entries[i].type)
+			return 0;
+		if (rec->entries[i].type != CONF_RANGE
+		    && rec->strings_len <= rec->entries[i].str)
+			return 0;
+		if (rec->entries[i].type == CONF_SHARED_NET) {
+			num_local++;
+			continue;
+		}
+		if (CONF_NET_LOCAL(num_local) <= rec->entries[i].net)
+			return 0;
+		if (rec->entries[i].type == CONF_RANGE && rec->entries[i].arg != IPv4
+		    && rec->entries[i].arg != IPv6)
+			return 0;
+	}
+	return 1;
+}
+
+/*! \brief Read configuration cache from config.config_cache.  The file
+ * is read with a single read call.  Nothing is loaded if the cache is
+ * missing or broken, or it was made with different options.  The cache
+ * is read only once. */
+void load_config_cache(void)
+{
+	struct conf_cache_header h;
+	struct conf_cache_record cr;
+	struct conf_record *rec;
+	struct stat st;
+	char *buf;
+	const char *p, *end;
+	size_t have = 0, need;
+	ssize_t len;
+	uint32_t i;
+	int fd;
+
+	if (conf_cache_loaded)
+		return;
+	conf_cache_loaded = 1;
+	fd = open(config.config_cache, O_RDONLY);
+	if (fd < 0)
+		return;
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size < (off_t)sizeof(h)) {
+		close(fd);
+		return;
+	}
+	buf = xmalloc(st.st_size);
+	while (have < (size_t)st.st_size
+	       && (len = read(fd, buf + have, st.st_size - have)) > 0)
+		have += len;
+	close(fd);
+	p = buf;
+	end = buf + have;
+	memcpy(&h, p, sizeof(h));
+	p += sizeof(h);
+	if (have != (size_t)st.st_size || memcmp(h.magic, CONF_CACHE_MAGIC, sizeof(h.magic))
+	    || h.all_as_shared != config.all_as_shared
+	    || h.checksum != conf_cache_checksum(CONF_CACHE_CHECKSUM_INIT, p, end - p)) {
+		free(buf);
+		return;
+	}
+	for (i = 0; i < h.num_records; i++) {
+		if ((size_t)(end - p) < sizeof(cr))
+			goto broken;
+		memcpy(&cr, p, sizeof(cr));
+		p += sizeof(cr);
+		need = (size_t)cr.path_len + (size_t)cr.num_entries * sizeof(struct conf_entry)
+		    + cr.strings_len;
+		if (cr.path_len == 0 || (size_t)(end - p) < need)
+			goto broken;
+		rec = xcalloc(1, sizeof(struct conf_record));
+		append_conf_record(rec);
+		rec->path = xmalloc(cr.path_len + 1);
+		memcpy(rec->path, p, cr.path_len);
+		rec->path[cr.path_len] = '\0';
+		p += cr.path_len;
+		rec->dev = cr.dev;
+		rec->ino = cr.ino;
+		rec->size = cr.size;
+		rec->mtime = cr.mtime;
+		rec->ctime = cr.ctime;
+		rec->inherited_all = cr.inherited_all;
+		rec->num_entries = rec->entries_size = cr.num_entries;
+		rec->entries = xmalloc(sizeof(struct conf_entry) * (cr.num_entries + 1));
+		memcpy(rec->entries, p, sizeof(struct conf_entry) * cr.num_entries);
+		p += sizeof(struct conf_entry) * cr.num_entries;
+		rec->strings_len = rec->strings_size = cr.strings_len;
+		rec->strings = xmalloc(cr.strings_len + 1);
+		memcpy(rec->strings, p, cr.strings_len);
+		p += cr.strings_len;
+		if (!conf_record_is_sane(rec))
+			goto broken;
+	}
+	free(buf);
+	return;
+ broken:
+	free(buf);
+	free_conf_records();
+}
+
+/*! \brief Find configuration record of a file that has not changed since
+ * the record was made.
+ * \param path Path of the file.
+ * \param inherited_all True when the file is not included from a shared
+ * network, which affects how subnets are handled.
+ * \return The record, or NULL if the file needs to be parsed. */
+struct conf_record *find_conf_record(const char *restrict path, const int inherited_all)
+{
+	struct conf_record *rec;
+	struct stat st;
+	unsigned int i;
+
+	for (i = 0; i < num_conf_records; i++) {
+		rec = conf_records[i];
+		if (rec->inherited_all != (uint32_t)inherited_all || strcmp(rec->path, path))
+			continue;
+		if (rec->parsed)
+			return rec;
+		if (stat(path, &st) || rec->dev != (uint64_t)st.st_dev
+		    || rec->ino != (uint64_t)st.st_ino || rec->size != (uint64_t)st.st_size
+		    || rec->mtime != CONF_STAT_MTIME(&st) || rec->ctime != CONF_STAT_CTIME(&st))
+			continue;
+		rec->used = 1;
+		return rec;
+	}
+	return NULL;
+}
+
+/*! \brief Start a configuration record for a file that is parsed.  The
+ * record is not yet known to find_conf_record(), so this can be called
+ * from many threads.
+ * \param path Path of the file.
+ * \param st Status of the file.
+ * \param inherited_all See find_conf_record().
+ * \return The record, that is to be given to add_conf_record(). */
+struct conf_record *new_conf_record(const char *restrict path, const struct stat *restrict st,
+				    const int inherited_all)
+{
+	struct conf_record *rec = xcalloc(1, sizeof(struct conf_record));
+
+	rec->path = xstrdup(path);
+	rec->dev = st->st_dev;
+	rec->ino = st->st_ino;
+	rec->size = st->st_size;
+	rec->mtime = CONF_STAT_MTIME(st);
+	rec->ctime = CONF_STAT_CTIME(st);
+	rec->inherited_all = inherited_all;
+	return rec;
+}
+
+/*! \brief Make a parsed configuration record available to
+ * find_conf_record(), and to be saved to the cache.
+ * \param rec The record. */
+void add_conf_record(struct conf_record *rec)
+{
+	append_conf_record(rec);
+	rec->used = 1;
+	rec->parsed = 1;
+	conf_cache_changed = 1;
+}
+
+/*! \brief Append an entry to a configuration record.
+ * \param rec The record.
+ * \param type Type of the entry.
+ * \param str Shared network name or include path, or NULL.
+ * \return The entry, that the caller fills. */
+struct conf_entry *add_conf_entry(struct conf_record *restrict rec,
+				  const enum conf_entry_type type, const char *restrict str)
+{
+	struct conf_entry *entry;
+
+	if (rec->num_entries == rec->entries_size) {
+		rec->entries_size = rec->entries_size ? rec->entries_size * 2 : 64;
+		rec->entries = xrealloc(rec->entries,
+					sizeof(struct conf_entry) * rec->entries_size);
+	}
+	entry = rec->entries + rec->num_entries++;
+	memset(entry, 0, sizeof(*entry));
+	entry->type = type;
+	if (str != NULL) {
+		const size_t len = strlen(str) + 1;
+
+		if (rec->strings_size < rec->strings_len + len) {
+			rec->strings_size = rec->strings_size ? rec->strings_size : 1024;
+			while (rec->strings_size < rec->strings_len + len)
+				rec->strings_size *= 2;
+			rec->strings = xrealloc(rec->strings, rec->strings_size);
+		}
+		memcpy(rec->strings + rec->strings_len, str, len);
+		entry->str = rec->strings_len;
+		rec->strings_len += len;
+	}
+	return entry;
+}
+
+/*! \brief Write the configuration files used in this run to
+ * config.config_cache, if any of them was parsed.  The file is written
+ * to a temporary name and renamed.  Failures are reported, but they are
+ * not fatal. */
+void save_config_cache(void)
+{
+	struct conf_cache_header h;
+	struct conf_cache_record cr;
+	struct conf_record *rec;
+	unsigned int i;
+	char *tmp;
+	FILE *f;
+#ifndef HAVE_STRUCT_STAT_ST_MTIM
+	const uint64_t now = time(NULL);
+#endif
+
+	if (!config.config_cache[0] || !conf_cache_changed)
+		return;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CONF_CACHE_MAGIC, sizeof(h.magic));
+	h.all_as_shared = config.all_as_shared;
+	for (i = 0; i < num_conf_records; i++)
+		h.num_records += conf_records[i]->used;
+	tmp = xmalloc(strlen(config.config_cache) + 5);
+	sprintf(tmp, "%s.tmp", config.config_cache);
+	f = fopen(tmp, "w");
+	if (f == NULL) {
+		error(0, errno, "save_config_cache: %s", tmp);
+		free(tmp);
+		return;
+	}
+	/* the header is rewritten when the checksum is known */
+	fwrite(&h, sizeof(h), 1, f);
+	h.checksum = CONF_CACHE_CHECKSUM_INIT;
+	for (i = 0; i < num_conf_records; i++) {
+		rec = conf_records[i];
+		if (!rec->used)
+			continue;
+		memset(&cr, 0, sizeof(cr));
+		cr.dev = rec->dev;
+		cr.ino = rec->ino;
+		cr.size = rec->size;
+		cr.mtime = rec->mtime;
+		cr.ctime = rec->ctime;
+#ifndef HAVE_STRUCT_STAT_ST_MTIM
+		/* a later change within the same second would go unnoticed */
+		if (now <= rec->mtime || now <= rec->ctime)
+			cr.mtime = UINT64_MAX;
+#endif
+		cr.inherited_all = rec->inherited_all;
+		cr.path_len = strlen(rec->path);
+		cr.num_entries = rec->num_entries;
+		cr.strings_len = rec->strings_len;
+		write_conf_cache(f, &cr, sizeof(cr), &h.checksum);
+		write_conf_cache(f, rec->path, cr.path_len, &h.checksum);
+		write_conf_cache(f, rec->entries, sizeof(struct conf_entry) * cr.num_entries,
+				 &h.checksum);
+		write_conf_cache(f, rec->strings, cr.strings_len, &h.checksum);
+	}
+	if (fseek(f, 0, SEEK_SET) == 0)
+		fwrite(&h, sizeof(h), 1, f);
+	if (close_stream(f)) {
+		error(0, errno, "save_config_cache: %s", tmp);
+		unlink(tmp);
+	} else if (rename(tmp, config.config_cache))
+		error(0, errno, "save_config_cache: %s", config.config_cache);
+	free(tmp);
+}
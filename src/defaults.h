@@ -48,8 +48,50 @@
  * files.  */
 static const size_t MAXLEN = 1024;
 
-/*! \var SHARED_NETWORKS
- * \brief Maximum number of different shared networks in dhcpd.conf file. */
-static const unsigned int SHARED_NETWORKS = 8192;
+/*! \var MAX_JOBS
+ * \brief Maximum number of lease file parser threads. */
+static const unsigned int MAX_JOBS = 256;
+
+/*! \var COUNT_RANGES_PER_JOB
+ * \brief Smallest number of ranges per thread that makes counting the
+ * ranges in parallel worth the thread start up. */
+static const unsigned int COUNT_RANGES_PER_JOB = 1024;
+
+/*! \var LEASE_BUFFER_SIZE
+ * \brief Initial size of lease file read buffers, when the file is read
+ * by a separate thread. */
+static const size_t LEASE_BUFFER_SIZE = 1 << 20;
+
+/*! \var ARENA_BLOCK_SIZE
+ * \brief Size of allocation arena blocks. */
+static const size_t ARENA_BLOCK_SIZE = 1 << 16;
+
+/*! \var LEASE_TABLE_MIN
+ * \brief Smallest number of slots in a leases hash. */
+static const size_t LEASE_TABLE_MIN = 64;
+
+/*! \var LEASE_FILE_BYTES
+ * \brief Average size of a lease in dhcpd.leases file, that is used to
+ * estimate number of leases from file size. */
+static const size_t LEASE_FILE_BYTES = 300;
+
+/*! \var LEASE_SNIFF_BYTES
+ * \brief How much of the beginning of dhcpd.leases file is looked at to
+ * find out the IP version before dhcpd.conf is parsed. */
+static const size_t LEASE_SNIFF_BYTES = 1 << 16;
+
+/*! \var MAX_STATE_ADDRESSES
+ * \brief Largest total size of IPv4 ranges that is counted with lease
+ * state bitmaps, using a quarter byte per address. */
+static const double MAX_STATE_ADDRESSES = 1 << 28;
+
+/*! \var V4_TABLE_SIZE
+ * \brief Number of /16 networks in IPv4 range index table. */
+static const unsigned int V4_TABLE_SIZE = 1 << 16;
+
+/*! \var INDEX_LEAF_SIZE
+ * \brief Largest number of interval starts in IPv6 range index trie
+ * node that is binary searched rather than split further. */
+static const unsigned int INDEX_LEAF_SIZE = 16;
 
 #endif				/* DEFAULTS_H */
@@ -44,6 +44,9 @@
 #include <getopt.h>
 #include <stdio.h>
 #include <limits.h>
+#ifdef HAVE_PTHREAD_H
+# include <pthread.h>
+#endif
 
 #include "close-stream.h"
 #include "closeout.h"
@@ -62,20 +65,21 @@ struct shared_network_t *shared_networks;
 unsigned int num_shared_networks;
 struct range_t *ranges;
 unsigned int num_ranges;
-struct leases_t *leases;
+struct outside_t outside_ranges;
+struct lease_table leases;
 unsigned int RANGES;
+unsigned int SHARED_NETWORKS;
 
 /* Function pointers */
-int (*parse_ipaddr) (const char *restrict src, union ipaddr_t *restrict dst);
+int (*parse_ipaddr) (const char *restrict src, const size_t len, union ipaddr_t *restrict dst);
 void (*copy_ipaddr) (union ipaddr_t *restrict dst, const union ipaddr_t *restrict src);
 const char *(*ntop_ipaddr) (const union ipaddr_t *ip);
 double (*get_range_size) (const struct range_t *r);
-int (*xstrstr) (const char *restrict str);
+int (*xstrstr) (const char *restrict str, const size_t len);
 int (*ipcomp) (const union ipaddr_t *restrict a, const union ipaddr_t *restrict b);
-int (*leasecomp) (const struct leases_t *restrict a, const struct leases_t *restrict b);
 int (*output_analysis) (void);
-void (*add_lease) (union ipaddr_t *ip, enum ltype type);
-struct leases_t *(*find_lease) (union ipaddr_t *ip);
+struct leases_t *(*add_lease) (struct lease_table *table, union ipaddr_t *ip, enum ltype type);
+struct leases_t *(*find_lease) (struct lease_table *table, union ipaddr_t *ip);
 
 static int return_limit(const char c)
 {
@@ -86,11 +90,63 @@ static int return_limit(const char c)
 	return 0;
 }
 
+#ifdef HAVE_PTHREAD_H
+/*! \brief Thread that parses dhcpd.conf while the lease file is parsed.
+ * \param arg Output of parse_config() return value.
+ * \return NULL. */
+static void *parse_config_job(void *arg)
+{
+	int *version = arg;
+
+	*version = parse_config(1, config.dhcpdconf_file, shared_networks);
+	return NULL;
+}
+
+/*! \brief Parse dhcpd.conf and the lease file at the same time.  The
+ * parsers share only the IP version, that is sniffed from the lease file
+ * before either of them starts.  The lease file parser cannot use the
+ * ranges, so it collects every lease to the leases hash.  If the first
+ * range in dhcpd.conf is of a different IP version, the results are
+ * thrown away, and the files are parsed one after the other.  The jobs
+ * are split between the two parsers.
+ * \return True if the files were parsed. */
+static int parse_files_concurrently(void)
+{
+	pthread_t thread;
+	int version, conf_version, e;
+	const unsigned int jobs = config.jobs;
+
+	if (config.jobs < 2 || config.scan_backwards)
+		return 0;
+	version = sniff_lease_version();
+	if (version == IPvUNKNOWN)
+		return 0;
+	set_ipv_functions(version);
+	/* both parsers read config.jobs, and it is not changed while they run */
+	config.jobs = jobs / 2;
+	e = pthread_create(&thread, NULL, parse_config_job, &conf_version);
+	if (e)
+		error(EXIT_FAILURE, e, "parse_config: pthread_create");
+	parse_leases(0);
+	e = pthread_join(thread, NULL);
+	if (e)
+		error(EXIT_FAILURE, e, "parse_config: pthread_join");
+	config.jobs = jobs;
+	if (conf_version == version) {
+		prepare_data();
+		return 1;
+	}
+	reset_config();
+	delete_all_leases();
+	config.backups_found = 0;
+	set_ipv_functions(IPvUNKNOWN);
+	return 0;
+}
+#endif				/* HAVE_PTHREAD_H */
+
 /*! \brief Start of execution.  Parse options, and call other other
- * functions one after another.  At the moment adding threading support
- * would be difficult, but there does not seem to be valid reason to
- * consider that.  Overall the analysis already quick enough even without
- * making it parallel.
+ * functions one after another.  Only file parsing and range counting can
+ * use threads, see --jobs option.
  *
  * \return Return value indicates success or fail or analysis, unless
  * either --warning or --critical options are in use, which makes the
@@ -108,7 +164,12 @@ int main(int argc, char **argv)
 		OPT_CRIT,
 		OPT_MINSIZE,
 		OPT_WARN_COUNT,
-		OPT_CRIT_COUNT
+		OPT_CRIT_COUNT,
+		OPT_JOBS,
+		OPT_SCAN_BACKWARDS,
+		OPT_STATE_FILE,
+		OPT_CONFIG_CACHE,
+		OPT_OUTSIDE
 	};
 	int ret_val;
 
@@ -130,6 +191,11 @@ int main(int argc, char **argv)
 		{"minsize", required_argument, NULL, OPT_MINSIZE},
 		{"perfdata", no_argument, NULL, 'p'},
 		{"all-as-shared", no_argument, NULL, 'A'},
+		{"jobs", required_argument, NULL, OPT_JOBS},
+		{"scan-backwards", no_argument, NULL, OPT_SCAN_BACKWARDS},
+		{"state-file", required_argument, NULL, OPT_STATE_FILE},
+		{"config-cache", required_argument, NULL, OPT_CONFIG_CACHE},
+		{"outside", no_argument, NULL, OPT_OUTSIDE},
 		{NULL, 0, NULL, 0}
 	};
 
@@ -140,9 +206,13 @@ int main(int argc, char **argv)
 	config.dhcpdconf_file = xmalloc(sizeof(char) * MAXLEN);
 	config.dhcpdlease_file = xmalloc(sizeof(char) * MAXLEN);
 	config.output_file = xmalloc(sizeof(char) * MAXLEN);
+	config.state_file = xmalloc(sizeof(char) * MAXLEN);
+	config.config_cache = xmalloc(sizeof(char) * MAXLEN);
 	/* Make sure string has zero length if there is no
 	 * command line option */
 	config.output_file[0] = '\0';
+	config.state_file[0] = '\0';
+	config.config_cache[0] = '\0';
 	/* Alarming defaults. */
 	config.snet_alarms = 0;
 	config.warning = ALARM_WARN;
@@ -164,6 +234,9 @@ int main(int argc, char **argv)
 	config.backups_found = 0;
 	/* Treat single networks as shared with network CIDR as name */
 	config.all_as_shared = 0;
+	/* Parse lease file in one thread */
+	config.jobs = 1;
+	config.scan_backwards = 0;
 	prepare_memory();
 	/* Parse command line options */
 	while (1) {
@@ -195,10 +268,10 @@ int main(int argc, char **argv)
 				p = p->next;
 			for (len = 0; len < strlen(optarg); len++) {
 				if (config.sorts == NULL) {
-					config.sorts = xcalloc(1, sizeof(struct output_sort));
+					config.sorts = arena_alloc(sizeof(struct output_sort));
 					p = config.sorts;
 				} else {
-					p->next = xcalloc(1, sizeof(struct output_sort));
+					p->next = arena_alloc(sizeof(struct output_sort));
 					p = p->next;
 				}
 				p->func = field_selector(optarg[len]);
@@ -240,6 +313,27 @@ int main(int argc, char **argv)
 		case OPT_MINSIZE:
 			config.minsize = strtod_or_err(optarg, "illegal argument");
 			break;
+		case OPT_JOBS:
+			{
+				double jobs = strtod_or_err(optarg, "illegal argument");
+
+				if (jobs < 1 || MAX_JOBS < jobs || jobs != (unsigned int)jobs)
+					error(EXIT_FAILURE, 0, "illegal argument: %s", quote(optarg));
+				config.jobs = jobs;
+			}
+			break;
+		case OPT_SCAN_BACKWARDS:
+			config.scan_backwards = 1;
+			break;
+		case OPT_STATE_FILE:
+			strncpy(config.state_file, optarg, MAXLEN - 1);
+			break;
+		case OPT_CONFIG_CACHE:
+			strncpy(config.config_cache, optarg, MAXLEN - 1);
+			break;
+		case OPT_OUTSIDE:
+			config.print_outside = 1;
+			break;
 		case 'p':
 			/* Print additional performance data in alarming mode */
 			config.perfdata = 1;
@@ -259,6 +353,8 @@ int main(int argc, char **argv)
 			      program_name);
 		}
 	}
+	if (config.scan_backwards && config.state_file[0])
+		error(EXIT_FAILURE, 0, "--scan-backwards and --state-file cannot be used together");
 	/* Output function selection */
 	switch (print_mac_addreses_tmp[0]) {
 	case 't':
@@ -266,6 +362,8 @@ int main(int argc, char **argv)
 		config.print_mac_addreses = 0;
 		break;
 	case 'a':
+		if (config.print_outside)
+			error(EXIT_FAILURE, 0, "--outside cannot be used with alarm output");
 		output_analysis = output_alarming;
 		config.print_mac_addreses = 0;
 		break;
@@ -302,13 +400,20 @@ int main(int argc, char **argv)
 	}
 	/* Do the job */
 	set_ipv_functions(IPvUNKNOWN);
-	parse_config(1, config.dhcpdconf_file, shared_networks);
-	parse_leases();
-	prepare_data();
+#ifdef HAVE_PTHREAD_H
+	if (!parse_files_concurrently())
+#endif
+	{
+		parse_config(1, config.dhcpdconf_file, shared_networks);
+		prepare_data();
+		parse_leases(1);
+	}
 	do_counting();
 	tmp_ranges = xmalloc(sizeof(struct range_t) * num_ranges);
-	if (config.sorts != NULL)
+	if (config.sorts != NULL) {
+		rank_shared_network_names();
 		mergesort_ranges(ranges, num_ranges, tmp_ranges);
+	}
 	if (config.reverse_order == 1)
 		flip_ranges(ranges, tmp_ranges);
 	free(tmp_ranges);
@@ -323,11 +428,12 @@ void prepare_memory(void)
 {
 	config.ip_version = IPvUNKNOWN;
 	RANGES = 64;
+	SHARED_NETWORKS = 64;
 	num_ranges = num_shared_networks = 0;
 	shared_networks = xmalloc(sizeof(struct shared_network_t) * SHARED_NETWORKS);
 	ranges = xmalloc(sizeof(struct range_t) * RANGES);
 	/* First shared network entry is all networks */
-	shared_networks->name = xstrdup("All networks");
+	shared_networks->name = arena_strdup("All networks");
 	shared_networks->used = 0;
 	shared_networks->touched = 0;
 	shared_networks->backups = 0;
@@ -45,6 +45,7 @@
 # include <config.h>
 # include <arpa/inet.h>
 # include <stddef.h>
+# include <stdint.h>
 # include <stdio.h>
 # include <string.h>
 # include <uthash.h>
@@ -70,12 +71,42 @@
 #  define _DP_ATTRIBUTE_HOT	/* empty */
 # endif
 
+/*! \def _DP_INLINE
+ * \brief Force inlining of a function that has an IP version argument.
+ * When the version is a constant the compiler removes the code of the
+ * other version, and such function works as a template that is
+ * instantiated separately for IPv4 and IPv6.
+ */
+# ifdef __GNUC__
+#  define _DP_INLINE inline __attribute__ ((__always_inline__))
+# else
+#  define _DP_INLINE inline
+# endif
+
 /*! \union ipaddr_t
  * \brief Memory space for a binary IP address saving. */
 union ipaddr_t {
 	uint32_t v4;
 	unsigned char v6[16];
 };
+/*! \brief Half of an IPv6 address as a number.
+ * \param p First byte of the half.
+ * \return The half, that has the first byte in the high bits. */
+static inline uint64_t ipv6_half(const unsigned char *p)
+{
+	return (uint64_t)p[0] << 56 | (uint64_t)p[1] << 48 | (uint64_t)p[2] << 40 |
+	    (uint64_t)p[3] << 32 | (uint64_t)p[4] << 24 | (uint64_t)p[5] << 16 |
+	    (uint64_t)p[6] << 8 | (uint64_t)p[7];
+}
+# ifdef HAVE_UNSIGNED___INT128
+/*! \brief IPv6 address as a 128 bit number.
+ * \param addr Binary IP.
+ * \return The number. */
+static inline unsigned __int128 ipv6_int(const union ipaddr_t *addr)
+{
+	return (unsigned __int128)ipv6_half(addr->v6) << 64 | ipv6_half(addr->v6 + 8);
+}
+# endif
 /*! \enum dhcp_version
  * \brief The IP version, IPv4 or IPv6, served by the dhcpd.
  */
@@ -105,50 +136,162 @@ enum prefix_t {
 struct shared_network_t {
 	char *name;
 	double available;
-	double used;
-	double touched;
-	double backups;
+	uint64_t used;
+	uint64_t touched;
+	uint64_t backups;
 	int netmask;
+	unsigned int name_id;
+};
+/*! \struct outside_t
+ * \brief Counters for leases that are not in any range.
+ */
+struct outside_t {
+	uint64_t used;
+	uint64_t touched;
+	uint64_t backups;
 };
 /*! \struct range_t
- * \brief Counters for an individual range.
+ * \brief Counters for an individual range.  When lease states are
+ * collected to bitmaps the states has two bits per address.
  */
 struct range_t {
 	struct shared_network_t *shared_net;
 	union ipaddr_t first_ip;
 	union ipaddr_t last_ip;
-	double count;
-	double touched;
-	double backups;
+	uint64_t count;
+	uint64_t touched;
+	uint64_t backups;
+	uint64_t *states;
 };
 /*! \enum isc_conf_parser
  * \brief Configuration file parsing state flags.
  */
 enum isc_conf_parser {
 	ITS_NOTHING_INTERESTING,
-	ITS_A_RANGE_FIRST_IP,
-	ITS_A_RANGE_SECOND_IP,
+	ITS_A_RANGE,
 	ITS_A_SHAREDNET,
-	ITS_AN_INCLUCE,
+	ITS_AN_INCLUDE,
 	ITS_A_SUBNET,
 	ITS_A_NETMASK
 };
+/*! \enum conf_entry_type
+ * \brief Statements saved to configuration cache.
+ */
+enum conf_entry_type {
+	CONF_RANGE,
+	CONF_SHARED_NET,
+	CONF_INCLUDE
+};
+/*! \def CONF_NET_ALL
+ * \brief Configuration cache reference to "All networks".
+ */
+/*! \def CONF_NET_INHERITED
+ * \brief Configuration cache reference to the shared network of the
+ * include statement, that caused the file to be parsed.
+ */
+/*! \def CONF_NET_LOCAL
+ * \brief Configuration cache reference to Nth shared network of the
+ * file, counting from zero.
+ */
+# define CONF_NET_ALL		0
+# define CONF_NET_INHERITED	1
+# define CONF_NET_LOCAL(n)	((n) + 2)
+/*! \struct conf_entry
+ * \brief A statement in configuration cache.  The net is a shared
+ * network reference of a range or an include, arg is IP version of a
+ * range or netmask of a shared network, and str is offset of shared
+ * network name or include file path in the strings.
+ */
+struct conf_entry {
+	uint32_t type;
+	uint32_t net;
+	int32_t arg;
+	uint32_t str;
+	union ipaddr_t first_ip;
+	union ipaddr_t last_ip;
+};
+/*! \struct conf_record
+ * \brief Outcome of parsing a dhcpd.conf file, and identity of the file
+ * when it was parsed.
+ */
+struct conf_record {
+	char *path;
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	uint64_t mtime;
+	uint64_t ctime;
+	uint32_t inherited_all;
+	uint32_t num_entries;
+	uint32_t strings_len;
+	uint32_t entries_size;
+	uint32_t strings_size;
+	struct conf_entry *entries;
+	char *strings;
+	unsigned int
+		used:1,
+		parsed:1;
+};
 /*! \enum ltype
  * \brief Lease state types.
  */
 enum ltype {
 	ACTIVE,
 	FREE,
-	BACKUP
+	BACKUP,
+	NOSTATE
 };
+/*! \enum ethernet_type
+ * \brief Storage of lease hardware ethernet address.  ETHERNET_SPARE is
+ * a lease without address, that has a string from an earlier address to
+ * be reused.
+ */
+enum ethernet_type {
+	ETHERNET_NONE,
+	ETHERNET_BINARY,
+	ETHERNET_STRING,
+	ETHERNET_SPARE
+};
+/*! \def MAC_STRING_LEN
+ * \brief Length of hardware ethernet address in text form.
+ */
+# define MAC_STRING_LEN 17
 /*! \struct leases_t
- * \brief An individual lease. The leaases are hashed.
+ * \brief An individual lease, and a slot in the leases hash.  Hardware
+ * ethernet address is binary, or an offset to lease_table strings when
+ * the address does not have the usual form.
  */
 struct leases_t {
 	union ipaddr_t ip;	/* ip as key */
+	union {
+		unsigned char binary[6];
+		uint32_t string;
+	} ethernet;
 	enum ltype type;
-	char *ethernet;
-	UT_hash_handle hh;
+	unsigned char in_use;
+	unsigned char ethernet_type;
+};
+/*! \struct lease_table
+ * \brief Open addressing hash of leases.  The number of slots is a power
+ * of two, and the slot of an IP is the high bits of its 64 bit hash.
+ */
+struct lease_table {
+	struct leases_t *slots;
+	size_t size;
+	size_t count;
+	unsigned int shift;
+	char *strings;
+	size_t strings_len;
+	size_t strings_size;
+};
+/*! \struct lease_columns
+ * \brief Leases sorted by address, as an array of addresses and an
+ * array of lease states.
+ */
+struct lease_columns {
+	union ipaddr_t *ips;
+	unsigned char *states;
+	size_t count;
 };
 /*! \enum limbits
  * \brief Output limit bits: R_BIT ranges, S_BIT shared networks, A_BIT all.
@@ -188,18 +331,25 @@ struct configuration_t {
 	char *dhcpdlease_file;
 	struct output_sort *sorts;
 	char *output_file;
+	char *state_file;
+	char *config_cache;
 	double warning;
 	double critical;
 	double warn_count;
 	double crit_count;
 	double minsize;
+	unsigned int jobs;
+	/* not a bit field, the lease file parser sets it while dhcpd.conf
+	 * parser may read the flags */
+	unsigned int backups_found;
 	unsigned int
 		reverse_order:1,
-		backups_found:1,
 		snet_alarms:1,
 		print_mac_addreses:1,
 		perfdata:1,
 		all_as_shared:1,
+		scan_backwards:1,
+		print_outside:1,
 		header_limit:3,
 		number_limit:3;
 };
@@ -216,27 +366,40 @@ extern unsigned int num_shared_networks;
 extern struct range_t *ranges;
 /* \var num_ranges Number of ranges found. */
 extern unsigned int num_ranges;
-/* \var leases Pointer holding all leases. */
-extern struct leases_t *leases;
+/* \var outside_ranges Counters of leases outside of ranges. */
+extern struct outside_t outside_ranges;
+/* \var leases Table holding all leases. */
+extern struct lease_table leases;
 /*! \var RANGES Maximum number of ranges. */
 extern unsigned int RANGES;
+/*! \var SHARED_NETWORKS Maximum number of shared networks. */
+extern unsigned int SHARED_NETWORKS;
 
 /* Function prototypes */
 extern void prepare_memory(void);
 extern void set_ipv_functions(int version);
-extern int parse_leases(void);
-extern void parse_config(int, const char *restrict, struct shared_network_t *restrict)
+extern int parse_leases(const int use_ranges);
+extern int sniff_lease_version(void);
+extern int parse_config(int, const char *restrict, struct shared_network_t *restrict)
     __attribute__ ((nonnull(2, 3)));
+extern void rank_shared_network_names(void);
+extern void reset_config(void);
 extern void prepare_data(void);
 extern void do_counting(void);
 extern void flip_ranges(struct range_t *restrict flip_me, struct range_t *restrict tmp_ranges)
     __attribute__ ((nonnull(1, 2)));
 /* support functions */
-extern int (*parse_ipaddr) (const char *restrict src, union ipaddr_t *restrict dst);
-extern int parse_ipaddr_init(const char *restrict src,
+extern int (*parse_ipaddr) (const char *restrict src, const size_t len,
+			    union ipaddr_t *restrict dst);
+extern int parse_ipaddr_any(const char *restrict src, const size_t len,
+			    union ipaddr_t *restrict dst);
+extern int parse_ipaddr_init(const char *restrict src, const size_t len,
 			     union ipaddr_t *restrict dst);
-extern int parse_ipaddr_v4(const char *restrict src, union ipaddr_t *restrict dst);
-extern int parse_ipaddr_v6(const char *restrict src, union ipaddr_t *restrict dst);
+extern int parse_ipaddr_v4(const char *restrict src, const size_t len,
+			   union ipaddr_t *restrict dst);
+extern int parse_ipaddr_v6(const char *restrict src, const size_t len,
+			   union ipaddr_t *restrict dst);
+extern int parse_ipv6(const char *restrict src, const size_t len, unsigned char *restrict dst);
 
 extern void (*copy_ipaddr) (union ipaddr_t *restrict dst, const union ipaddr_t *restrict src);
 extern void copy_ipaddr_init(union ipaddr_t *restrict dst,
@@ -254,12 +417,40 @@ extern double get_range_size_init(const struct range_t *r);
 extern double get_range_size_v4(const struct range_t *r);
 extern double get_range_size_v6(const struct range_t *r);
 
-extern int (*xstrstr) (const char *restrict str);
-extern int xstrstr_init(const char *restrict str);
-extern int xstrstr_v4(const char *restrict str)
+extern int (*xstrstr) (const char *restrict str, const size_t len);
+extern int xstrstr_init(const char *restrict str, const size_t len);
+extern int xstrstr_v4(const char *restrict str, const size_t len)
 _DP_ATTRIBUTE_HOT;
-extern int xstrstr_v6(const char *restrict str)
+extern int xstrstr_v6(const char *restrict str, const size_t len)
+_DP_ATTRIBUTE_HOT;
+
+extern const char *next_lease_line(const char *restrict p, const char *restrict end)
 _DP_ATTRIBUTE_HOT;
+extern void prepare_lease_lexer(void);
+
+struct stat;
+extern size_t load_lease_state(const struct stat *st, const char *map, const size_t size,
+			       union ipaddr_t *addr, unsigned int *backups_found);
+extern void save_lease_state(const struct stat *st, const char *map, const size_t size,
+			     const union ipaddr_t *addr, const unsigned int backups_found);
+
+extern void load_config_cache(void);
+extern struct conf_record *find_conf_record(const char *restrict path,
+					    const int inherited_all);
+extern struct conf_record *new_conf_record(const char *restrict path,
+					   const struct stat *restrict st,
+					   const int inherited_all);
+extern void add_conf_record(struct conf_record *rec);
+extern struct conf_entry *add_conf_entry(struct conf_record *restrict rec,
+					 const enum conf_entry_type type,
+					 const char *restrict str);
+extern void save_config_cache(void);
+
+struct lease_source;
+extern int lease_file_is_compressed(const int fd);
+extern struct lease_source *open_lease_source(const int fd, const char *name);
+extern ssize_t read_lease_source(struct lease_source *src, char *buf, const size_t len);
+extern void close_lease_source(struct lease_source *src);
 
 extern double strtod_or_err(const char *restrict str, const char *restrict errmesg);
 extern void __attribute__ ((noreturn)) print_version(void);
@@ -273,13 +464,41 @@ extern int ipcomp_v4(const union ipaddr_t *restrict a,
 		     const union ipaddr_t *restrict b);
 extern int ipcomp_v6(const union ipaddr_t *restrict a,
 		     const union ipaddr_t *restrict b);
+/*! \def IPV_CALL(version, fn, ...)
+ * \brief Call the IPv4 or IPv6 variant of a function directly.  With
+ * IPvUNKNOWN the call goes via the function pointer that
+ * set_ipv_functions() has chosen.
+ */
+# define IPV_CALL(version, fn, ...)				\
+	((version) == IPv4 ? fn ## _v4(__VA_ARGS__) :		\
+	 (version) == IPv6 ? fn ## _v6(__VA_ARGS__) : fn(__VA_ARGS__))
 
-extern int (*leasecomp) (const struct leases_t *restrict a, const struct leases_t *restrict b);
-extern int leasecomp_init(const struct leases_t *restrict a
-			  __attribute__ ((unused)),
-			  const struct leases_t *restrict b __attribute__ ((unused)));
-extern int leasecomp_v4(const struct leases_t *restrict a, const struct leases_t *restrict b);
-extern int leasecomp_v6(const struct leases_t *restrict a, const struct leases_t *restrict b);
+/*! \brief Compare IP addresses of a known version without a function
+ * call.
+ * \param version IPv4, IPv6, or IPvUNKNOWN to use ipcomp.
+ * \param a,b Binary IP addresses.
+ * \return Like strcmp. */
+static _DP_INLINE int ip_cmp(const enum dhcp_version version,
+			     const union ipaddr_t *restrict a,
+			     const union ipaddr_t *restrict b)
+{
+	if (version == IPv4)
+		return (a->v4 > b->v4) - (a->v4 < b->v4);
+	if (version == IPv6) {
+# ifdef HAVE_UNSIGNED___INT128
+		const unsigned __int128 x = ipv6_int(a), y = ipv6_int(b);
+# else
+		uint64_t x = ipv6_half(a->v6), y = ipv6_half(b->v6);
+
+		if (x == y) {
+			x = ipv6_half(a->v6 + 8);
+			y = ipv6_half(b->v6 + 8);
+		}
+# endif
+		return (x > y) - (x < y);
+	}
+	return ipcomp(a, b);
+}
 
 extern int comp_cur(struct range_t *r1, struct range_t *r2);
 extern int comp_double(double f1, double f2);
@@ -308,19 +527,46 @@ extern int output_json(void);
 extern int output_csv(void);
 extern int output_alarming(void);
 /* Memory release, file closing etc */
+extern void *arena_alloc(size_t size);
+extern char *arena_strdup(const char *str);
 extern void clean_up(void);
-/* Hash functions */
-extern void (*add_lease) (union ipaddr_t *addr, enum ltype type);
-extern void add_lease_init(union ipaddr_t *addr, enum ltype type);
-extern void add_lease_v4(union ipaddr_t *addr, enum ltype type);
-extern void add_lease_v6(union ipaddr_t *addr, enum ltype type);
+/* Range index and state bitmaps */
+extern void build_range_index(void);
+extern unsigned int find_ranges(const union ipaddr_t *addr, const unsigned int **members);
+extern unsigned int find_ranges_v4(const union ipaddr_t *addr, const unsigned int **members);
+extern unsigned int find_ranges_v6(const union ipaddr_t *addr, const unsigned int **members);
+
+extern uint64_t **init_range_states(void);
+extern uint64_t **new_range_states(void);
+extern void merge_range_states(uint64_t **states, uint64_t **from);
+extern int set_range_state(uint64_t **states, const union ipaddr_t *addr,
+			   const enum ltype type, const int replace);
+extern void count_range_states(struct range_t *range);
+
+extern void init_lease_table(struct lease_table *table, size_t num);
+extern struct leases_t *(*add_lease) (struct lease_table *table, union ipaddr_t *addr,
+				      enum ltype type);
+extern struct leases_t *add_lease_init(struct lease_table *table, union ipaddr_t *addr,
+				       enum ltype type);
+extern struct leases_t *add_lease_v4(struct lease_table *table, union ipaddr_t *addr,
+				     enum ltype type);
+extern struct leases_t *add_lease_v6(struct lease_table *table, union ipaddr_t *addr,
+				     enum ltype type);
 
-extern struct leases_t *(*find_lease) (union ipaddr_t *addr);
-extern struct leases_t *find_lease_init(union ipaddr_t *addr);
-extern struct leases_t *find_lease_v4(union ipaddr_t *addr);
-extern struct leases_t *find_lease_v6(union ipaddr_t *addr);
+extern struct leases_t *(*find_lease) (struct lease_table *table, union ipaddr_t *addr);
+extern struct leases_t *find_lease_init(struct lease_table *table, union ipaddr_t *addr);
+extern struct leases_t *find_lease_v4(struct lease_table *table, union ipaddr_t *addr);
+extern struct leases_t *find_lease_v6(struct lease_table *table, union ipaddr_t *addr);
 
-extern void delete_lease(struct leases_t *lease);
+extern void set_lease_ethernet(struct lease_table *table, struct leases_t *lease,
+			       const char *mac, size_t len);
+extern const char *lease_ethernet(const struct lease_table *table,
+				  const struct leases_t *lease, char *buf);
+extern void prune_leases(struct lease_table *table, enum ltype type);
+extern void merge_leases(struct lease_table *table, struct lease_table *from);
+extern void sort_leases(struct lease_table *table);
+extern void lease_columns(const struct lease_table *table, struct lease_columns *cols);
+extern void free_lease_columns(struct lease_columns *cols);
 extern void delete_all_leases(void);
 
 #endif				/* DHCPD_POOLS_H */
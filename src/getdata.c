@@ -34,7 +34,7 @@
  */
 
 /*! \file getdata.c
- * \brief Functions to read data from dhcpd.conf and dhcdp.leases files.
+ * \brief Functions to read data from dhcpd.leases files.
  */
 
 #include <config.h>
@@ -49,6 +49,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+# include <pthread.h>
+#endif
 
 #include "error.h"
 #include "xalloc.h"
@@ -56,380 +63,817 @@
 #include "dhcpd-pools.h"
 #include "defaults.h"
 
-/*! \brief Lease file parser.  The parser can only read ISC DHCPD
- * dhcpd.leases file format.  */
-int parse_leases(void)
-{
-	FILE *dhcpd_leases;
-	char *line, *ipstring, macstring[20], *stop;
+/*! \struct lease_lexer
+ * \brief State of the lease file parser between lines.
+ */
+struct lease_lexer {
 	union ipaddr_t addr;
-	struct stat lease_file_stats;
-	int ethernets = 0;	/* boolean */
+	struct lease_table *table;
+	uint64_t **states;
+	unsigned int
+		backups_found:1,
+		chunked:1,
+		use_ranges:1;
+};
+
+/*! \brief Save binding state of the address of current lease block,
+ * either to range state bitmaps or to the leases hash.  Addresses that
+ * are outside of the ranges always go to the hash.
+ * \param lx The parser state.
+ * \param type Lease state.
+ * \param version The IP version. */
+static _DP_INLINE void set_lease_type(struct lease_lexer *restrict lx, const enum ltype type,
+				      const enum dhcp_version version)
+{
+	if (lx->states == NULL || set_range_state(lx->states, &lx->addr, type, 1) < 0)
+		IPV_CALL(version, add_lease, lx->table, &lx->addr, type);
+}
+
+/*! \brief Lease file line parser.  The line does not need to be NUL
+ * terminated, and it does not need to include the new line character.
+ * \param line Pointer to beginning of a line.
+ * \param len Length of the line.
+ * \param lx The parser state.  The IP address is updated when a new
+ * lease block begins.
+ * \param version The IP version, or IPvUNKNOWN when the first line of
+ * the lease file is not parsed yet. */
+static _DP_INLINE void parse_lease_line_ipv(const char *restrict line, const size_t len,
+					    struct lease_lexer *restrict lx,
+					    const enum dhcp_version version)
+{
+	const char *ip_begin, *ip_end, *end = line + len;
+	const int *plen;
+	size_t mac_len;
 	struct leases_t *lease;
+	int tok;
 
-	dhcpd_leases = fopen(config.dhcpdlease_file, "r");
-	if (dhcpd_leases == NULL)
-		error(EXIT_FAILURE, errno, "parse_leases: %s", config.dhcpdlease_file);
-#ifdef HAVE_POSIX_FADVISE
-# ifdef POSIX_FADV_SEQUENTIAL
-	if (posix_fadvise(fileno(dhcpd_leases), 0, 0, POSIX_FADV_SEQUENTIAL) != 0)
-		error(EXIT_FAILURE, errno, "parse_leases: fadvise %s", config.dhcpdlease_file);
-# endif				/* POSIX_FADV_SEQUENTIAL */
-#endif				/* HAVE_POSIX_FADVISE */
-	/* I found out that there's one lease address per 300 bytes in
-	 * dhcpd.leases file. Malloc is little bit pessimistic and uses 250.
-	 * If someone has higher density in lease file I'm interested to
-	 * hear about that. */
-	if (stat(config.dhcpdlease_file, &lease_file_stats))
-		error(EXIT_FAILURE, errno, "parse_leases: %s", config.dhcpdlease_file);
-	line = xmalloc(sizeof(char) * MAXLEN);
-	line[0] = '\0';
-	ipstring = xmalloc(sizeof(char) * MAXLEN);
-	ipstring[0] = '\0';
-	if (config.print_mac_addreses == 1)
-		ethernets = 1;
-	while (!feof(dhcpd_leases)) {
-		if (!fgets(line, MAXLEN, dhcpd_leases) && ferror(dhcpd_leases))
-			error(EXIT_FAILURE, errno, "parse_leases: %s", config.dhcpdlease_file);
-		switch (xstrstr(line)) {
-			/* It's a lease, save IP */
+	tok = IPV_CALL(version, xstrstr, line, len);
+	if (tok == NUM_OF_PREFIX)
+		return;
+	/* xstrstr_init() has set the version by now */
+	plen = prefix_length[(version == IPvUNKNOWN ? config.ip_version : version) - 1];
+	switch (tok) {
+		/* It's a lease, save IP */
+	case PREFIX_LEASE:
+		ip_begin = line + plen[PREFIX_LEASE];
+		if (end <= ip_begin)
+			break;
+		ip_end = memchr(ip_begin, ' ', end - ip_begin);
+		if (ip_end == NULL)
+			ip_end = end;
+		IPV_CALL(version, parse_ipaddr, ip_begin, ip_end - ip_begin, &lx->addr);
+		break;
+	case PREFIX_BINDING_STATE_FREE:
+	case PREFIX_BINDING_STATE_ABANDONED:
+	case PREFIX_BINDING_STATE_EXPIRED:
+	case PREFIX_BINDING_STATE_RELEASED:
+		set_lease_type(lx, FREE, version);
+		break;
+	case PREFIX_BINDING_STATE_ACTIVE:
+		/* replaces old entry, if exists */
+		set_lease_type(lx, ACTIVE, version);
+		break;
+	case PREFIX_BINDING_STATE_BACKUP:
+		set_lease_type(lx, BACKUP, version);
+		lx->backups_found = 1;
+		break;
+	case PREFIX_HARDWARE_ETHERNET:
+		mac_len = len - plen[PREFIX_HARDWARE_ETHERNET];
+		if (config.print_mac_addreses == 0 || mac_len == 0)
+			break;
+		if (MAC_STRING_LEN < mac_len)
+			mac_len = MAC_STRING_LEN;
+		lease = IPV_CALL(version, find_lease, lx->table, &lx->addr);
+		if (lease == NULL && lx->chunked)
+			/* The binding state may be in an earlier chunk.  */
+			lease = IPV_CALL(version, add_lease, lx->table, &lx->addr, NOSTATE);
+		if (lease != NULL)
+			set_lease_ethernet(lx->table, lease, line + plen[PREFIX_HARDWARE_ETHERNET],
+					   mac_len);
+		break;
+	default:
+		/* do nothing */ ;
+	}
+}
+
+/*! \brief Lease file line parser for a caller that does not know the IP
+ * version.  See parse_lease_line_ipv(). */
+static void parse_lease_line(const char *restrict line, const size_t len,
+			     struct lease_lexer *restrict lx)
+{
+	switch (config.ip_version) {
+	case IPv4:
+		parse_lease_line_ipv(line, len, lx, IPv4);
+		break;
+	case IPv6:
+		parse_lease_line_ipv(line, len, lx, IPv6);
+		break;
+	default:
+		parse_lease_line_ipv(line, len, lx, IPvUNKNOWN);
+	}
+}
+
+/*! \brief Prepare lease file parser state.
+ * \param lx The parser state.
+ * \param table The leases hash where results are stored. */
+static void init_lease_lexer(struct lease_lexer *lx, struct lease_table *table)
+{
+	memset(lx, 0, sizeof(*lx));
+	lx->table = table;
+}
+
+/*! \brief Parse lease file contents that are in memory.  The first line
+ * is always examined, after that only candidate lines are looked at.
+ * \param lx The parser state.
+ * \param p Beginning of a line.
+ * \param end End of the data.
+ * \param version The IP version. */
+static _DP_INLINE void parse_lease_buffer_ipv(struct lease_lexer *restrict lx, const char *p,
+					      const char *end, const enum dhcp_version version)
+{
+	const char *nl;
+
+	while (p != NULL) {
+		nl = memchr(p, '\n', end - p);
+		if (nl == NULL)
+			nl = end;
+		parse_lease_line_ipv(p, nl - p, lx, version);
+		p = next_lease_line(nl, end);
+	}
+}
+
+/*! \brief Parse lease file contents that are in memory with the parser
+ * instance of the IP version.  When the version is not known the first
+ * line is parsed on its own to find it out.  See parse_lease_buffer_ipv().
+ */
+static void parse_lease_buffer(struct lease_lexer *restrict lx, const char *p,
+			       const char *end)
+{
+	const char *nl;
+
+	if (config.ip_version == IPvUNKNOWN) {
+		nl = memchr(p, '\n', end - p);
+		if (nl == NULL)
+			nl = end;
+		parse_lease_line_ipv(p, nl - p, lx, IPvUNKNOWN);
+		p = next_lease_line(nl, end);
+		if (p == NULL)
+			return;
+	}
+	if (config.ip_version == IPv4)
+		parse_lease_buffer_ipv(lx, p, end, IPv4);
+	else
+		parse_lease_buffer_ipv(lx, p, end, IPv6);
+}
+
+/*! \brief Test if a line begins a lease block.  The address is the only
+ * parser state carried from a line to another, so the lease file can be
+ * split at these lines.
+ * \param p Beginning of a line.
+ * \param end End of the buffer.
+ * \return True if the line begins a lease block. */
+static inline int is_lease_block(const char *restrict p, const char *restrict end)
+{
+	if (config.ip_version == IPv4)
+		return 6 <= end - p && !memcmp(p, "lease ", 6);
+	return 9 <= end - p && !memcmp(p, "  iaaddr ", 9);
+}
+
+/*! \brief Estimate number of leases, so that the leases hash can be
+ * allocated once.  I found out that there's one lease address per 300
+ * bytes in dhcpd.leases file.  A lease file with long history has many
+ * blocks per address, so the estimate is limited to size of the ranges.
+ * \param bytes Size of the lease data.
+ * \param use_ranges False when the ranges are not known yet.
+ * \return Expected number of leases. */
+static size_t expected_leases(const size_t bytes, const unsigned int use_ranges)
+{
+	const size_t num = bytes / LEASE_FILE_BYTES;
+	double addresses = 0;
+	unsigned int i;
+
+	for (i = 0; use_ranges && i < num_ranges; i++)
+		addresses += get_range_size(ranges + i);
+	if (0 < addresses && addresses < num)
+		return addresses;
+	return num;
+}
+
+#ifdef HAVE_PTHREAD_H
+/*! \struct lease_chunk
+ * \brief A piece of the lease file parsed by a thread.
+ */
+struct lease_chunk {
+	pthread_t thread;
+	const char *begin;
+	const char *end;
+	struct lease_table table;
+	struct lease_lexer lx;
+};
+
+/*! \brief Thread start routine of the parallel lease file parser.
+ * \param arg The lease_chunk to be parsed.
+ * \return Always NULL. */
+static void *parse_lease_chunk(void *arg)
+{
+	struct lease_chunk *chunk = arg;
+
+	if (chunk->begin < chunk->end)
+		parse_lease_buffer(&chunk->lx, chunk->begin, chunk->end);
+	return NULL;
+}
+
+/*! \brief Find a line that begins a lease block.
+ * \param p Search start position, that must not be the first byte of
+ * the buffer.
+ * \param end End of the buffer.
+ * \return Beginning of the lease block, or end. */
+static const char *next_lease_block(const char *p, const char *end)
+{
+	/* p may be the beginning of a line */
+	p--;
+	while (p < end && (p = memchr(p, '\n', end - p)) != NULL) {
+		p++;
+		if (is_lease_block(p, end))
+			return p;
+	}
+	return end;
+}
+
+/*! \brief Parse lease file contents in config.jobs threads.  Results of
+ * the threads are merged in file order, so that the last record of an IP
+ * wins just like when the file is parsed from beginning to end.
+ * \param lx The parser state.
+ * \param p Beginning of a line.  The IP version must be known.
+ * \param end End of the data. */
+static void parse_lease_buffer_parallel(struct lease_lexer *restrict lx, const char *p,
+					const char *end)
+{
+	struct lease_chunk *chunks;
+	const size_t step = (end - p) / config.jobs;
+	unsigned int i;
+	int e;
+
+	/* select the line finder before threads use it */
+	next_lease_line(p, p);
+	chunks = xcalloc(config.jobs, sizeof(struct lease_chunk));
+	for (i = 0; i < config.jobs; i++) {
+		chunks[i].begin = i ? chunks[i - 1].end : p;
+		if (i + 1 < config.jobs && chunks[i].begin < p + step * (i + 1))
+			chunks[i].end = next_lease_block(p + step * (i + 1), end);
+		else if (i + 1 < config.jobs)
+			chunks[i].end = chunks[i].begin;
+		else
+			chunks[i].end = end;
+		init_lease_lexer(&chunks[i].lx, &chunks[i].table);
+		if (lx->states != NULL)
+			/* the table has only leases outside of ranges */
+			chunks[i].lx.states = new_range_states();
+		else
+			init_lease_table(&chunks[i].table,
+					 expected_leases(chunks[i].end - chunks[i].begin,
+							 lx->use_ranges));
+		chunks[i].lx.chunked = 1;
+		if (i == 0)
+			/* continue the block the first line began */
+			copy_ipaddr(&chunks[i].lx.addr, &lx->addr);
+		e = pthread_create(&chunks[i].thread, NULL, parse_lease_chunk, &chunks[i]);
+		if (e)
+			error(EXIT_FAILURE, e, "parse_leases: pthread_create");
+	}
+	for (i = 0; i < config.jobs; i++) {
+		e = pthread_join(chunks[i].thread, NULL);
+		if (e)
+			error(EXIT_FAILURE, e, "parse_leases: pthread_join");
+		if (lx->states != NULL)
+			merge_range_states(lx->states, chunks[i].lx.states);
+		merge_leases(lx->table, &chunks[i].table);
+		lx->backups_found |= chunks[i].lx.backups_found;
+		if (chunks[i].begin < chunks[i].end)
+			/* the block the last line belongs to */
+			copy_ipaddr(&lx->addr, &chunks[i].lx.addr);
+	}
+	free(chunks);
+}
+
+/*! \struct lease_pipe
+ * \brief Double buffered lease file reader.  A reader thread fills one
+ * buffer while the parser consumes the other.  Buffers hold only
+ * complete lines, the partial line at the end of a read is moved to the
+ * beginning of the next buffer.
+ */
+struct lease_pipe {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct lease_source *src;
+	unsigned int eof:1;
+	struct {
+		char *data;
+		size_t size;
+		size_t len;
+		unsigned int full:1;
+	} buf[2];
+};
+
+/*! \brief Fill a lease pipe buffer from file.  The buffer grows if a
+ * line does not fit in it.
+ * \param lp The lease pipe.
+ * \param i Index of the buffer owned by reader.
+ * \param have Number of bytes already in the buffer.
+ * \return Number of bytes in the buffer. */
+static size_t fill_lease_pipe(struct lease_pipe *lp, const int i, size_t have)
+{
+	ssize_t len;
+
+	while (1) {
+		if (have == lp->buf[i].size) {
+			if (memrchr(lp->buf[i].data, '\n', have) != NULL)
+				return have;
+			lp->buf[i].size *= 2;
+			lp->buf[i].data = xrealloc(lp->buf[i].data, lp->buf[i].size);
+		}
+		len = read_lease_source(lp->src, lp->buf[i].data + have,
+					lp->buf[i].size - have);
+		if (len == 0)
+			return have;
+		have += len;
+	}
+}
+
+/*! \brief Thread start routine of lease pipe reader.
+ * \param arg The lease_pipe.
+ * \return Always NULL. */
+static void *read_lease_pipe(void *arg)
+{
+	struct lease_pipe *lp = arg;
+	const char *nl;
+	size_t carry = 0, have;
+	int i = 0;
+
+	while (1) {
+		pthread_mutex_lock(&lp->lock);
+		while (lp->buf[i].full)
+			pthread_cond_wait(&lp->cond, &lp->lock);
+		pthread_mutex_unlock(&lp->lock);
+		/* the other buffer is only read by parser */
+		if (lp->buf[i].size < carry) {
+			lp->buf[i].size = lp->buf[!i].size;
+			lp->buf[i].data = xrealloc(lp->buf[i].data, lp->buf[i].size);
+		}
+		if (carry)
+			memcpy(lp->buf[i].data,
+			       lp->buf[!i].data + lp->buf[!i].len, carry);
+		have = fill_lease_pipe(lp, i, carry);
+		pthread_mutex_lock(&lp->lock);
+		if (have == carry) {
+			/* end of file, whatever is left is the last line */
+			lp->buf[i].len = have;
+			lp->buf[i].full = 1;
+			lp->eof = 1;
+		} else {
+			nl = memrchr(lp->buf[i].data, '\n', have);
+			lp->buf[i].len = nl ? (size_t)(nl - lp->buf[i].data + 1) : have;
+			lp->buf[i].full = 1;
+			carry = have - lp->buf[i].len;
+		}
+		pthread_cond_broadcast(&lp->cond);
+		pthread_mutex_unlock(&lp->lock);
+		if (lp->eof)
+			return NULL;
+		i = !i;
+	}
+}
+
+/*! \brief Parse lease file that cannot be mapped to memory, such as a
+ * pipe or a compressed file, so that reading and parsing overlap.
+ * \param lx The parser state.
+ * \param src The lease file input stream. */
+static void parse_leases_stream(struct lease_lexer *restrict lx, struct lease_source *src)
+{
+	struct lease_pipe lp;
+	pthread_t reader;
+	size_t total = 0;
+	int i = 0, e;
+
+	memset(&lp, 0, sizeof(lp));
+	pthread_mutex_init(&lp.lock, NULL);
+	pthread_cond_init(&lp.cond, NULL);
+	lp.src = src;
+	for (i = 0; i < 2; i++) {
+		lp.buf[i].size = LEASE_BUFFER_SIZE;
+		lp.buf[i].data = xmalloc(lp.buf[i].size);
+	}
+	e = pthread_create(&reader, NULL, read_lease_pipe, &lp);
+	if (e)
+		error(EXIT_FAILURE, e, "parse_leases: pthread_create");
+	for (i = 0;; i = !i) {
+		pthread_mutex_lock(&lp.lock);
+		while (!lp.buf[i].full && !lp.eof)
+			pthread_cond_wait(&lp.cond, &lp.lock);
+		pthread_mutex_unlock(&lp.lock);
+		if (!lp.buf[i].full)
+			break;
+		if (lp.buf[i].len) {
+			parse_lease_buffer(lx, lp.buf[i].data, lp.buf[i].data + lp.buf[i].len);
+			total += lp.buf[i].len;
+		}
+		pthread_mutex_lock(&lp.lock);
+		lp.buf[i].full = 0;
+		pthread_cond_broadcast(&lp.cond);
+		pthread_mutex_unlock(&lp.lock);
+	}
+	pthread_join(reader, NULL);
+	/* an empty file decides IP version like the stdio reader does */
+	if (total == 0)
+		parse_lease_line("", 0, lx);
+	free(lp.buf[0].data);
+	free(lp.buf[1].data);
+	pthread_cond_destroy(&lp.cond);
+	pthread_mutex_destroy(&lp.lock);
+}
+#else				/* HAVE_PTHREAD_H */
+/*! \brief Parse lease file that cannot be mapped to memory, such as a
+ * pipe or a compressed file.
+ * \param lx The parser state.
+ * \param src The lease file input stream. */
+static void parse_leases_stream(struct lease_lexer *restrict lx, struct lease_source *src)
+{
+	size_t size = LEASE_BUFFER_SIZE, have = 0, total = 0;
+	char *buf = xmalloc(size);
+	const char *nl;
+	ssize_t len;
+
+	while (1) {
+		if (have == size) {
+			size *= 2;
+			buf = xrealloc(buf, size);
+		}
+		len = read_lease_source(src, buf + have, size - have);
+		if (len == 0)
+			break;
+		have += len;
+		total += len;
+		nl = memrchr(buf, '\n', have);
+		if (nl == NULL)
+			continue;
+		parse_lease_buffer(lx, buf, nl + 1);
+		have -= nl + 1 - buf;
+		memmove(buf, nl + 1, have);
+	}
+	if (have)
+		parse_lease_buffer(lx, buf, buf + have);
+	/* an empty file decides IP version like the stdio reader does */
+	if (total == 0)
+		parse_lease_line("", 0, lx);
+	free(buf);
+}
+#endif				/* HAVE_PTHREAD_H */
+
+#ifdef HAVE_MMAP
+/*! \struct lease_segment
+ * \brief Outcome of a lease block, that is lines from a lease address up
+ * to the next one.
+ */
+struct lease_segment {
+	union ipaddr_t addr;
+	enum ltype type;
+	unsigned int has_ethernet:1;
+	char ethernet[MAC_STRING_LEN + 1];
+};
+
+/*! \brief Parse one lease block.  The binding state and hardware
+ * ethernet that are in effect at the end of the block are returned.
+ * \param seg Result of the parsing.
+ * \param p Beginning of the block.
+ * \param end End of the block.
+ * \param lx The parser state, only backups_found is updated. */
+static void parse_lease_segment(struct lease_segment *restrict seg, const char *p,
+				const char *end, struct lease_lexer *restrict lx)
+{
+	const char *nl, *ip_begin, *ip_end;
+	const int *plen = prefix_length[config.ip_version - 1];
+	size_t len;
+
+	memset(seg, 0, sizeof(*seg));
+	seg->type = NOSTATE;
+	for (; p != NULL; p = next_lease_line(nl, end)) {
+		nl = memchr(p, '\n', end - p);
+		if (nl == NULL)
+			nl = end;
+		len = nl - p;
+		switch (xstrstr(p, len)) {
 		case PREFIX_LEASE:
-			stop =
-			    memccpy(ipstring,
-				    line + (config.ip_version ==
-					    IPv4 ? 6 : 9), ' ', strlen(line));
-			if (stop != NULL) {
-				--stop;
-				*stop = '\0';
-			}
-			parse_ipaddr(ipstring, &addr);
+			ip_begin = p + plen[PREFIX_LEASE];
+			if (nl <= ip_begin)
+				break;
+			ip_end = memchr(ip_begin, ' ', nl - ip_begin);
+			if (ip_end == NULL)
+				ip_end = nl;
+			parse_ipaddr(ip_begin, ip_end - ip_begin, &seg->addr);
 			break;
 		case PREFIX_BINDING_STATE_FREE:
 		case PREFIX_BINDING_STATE_ABANDONED:
 		case PREFIX_BINDING_STATE_EXPIRED:
 		case PREFIX_BINDING_STATE_RELEASED:
-			if ((lease = find_lease(&addr)) != NULL)
-				delete_lease(lease);
-			add_lease(&addr, FREE);
+			seg->type = FREE;
+			seg->has_ethernet = 0;
 			break;
 		case PREFIX_BINDING_STATE_ACTIVE:
-			/* remove old entry, if exists */
-			if ((lease = find_lease(&addr)) != NULL)
-				delete_lease(lease);
-			add_lease(&addr, ACTIVE);
+			seg->type = ACTIVE;
+			seg->has_ethernet = 0;
 			break;
 		case PREFIX_BINDING_STATE_BACKUP:
-			/* remove old entry, if exists */
-			if ((lease = find_lease(&addr)) != NULL)
-				delete_lease(lease);
-			add_lease(&addr, BACKUP);
-			config.backups_found = 1;
+			seg->type = BACKUP;
+			seg->has_ethernet = 0;
+			lx->backups_found = 1;
 			break;
 		case PREFIX_HARDWARE_ETHERNET:
-			if (ethernets == 0)
+			len -= plen[PREFIX_HARDWARE_ETHERNET];
+			if (config.print_mac_addreses == 0 || len == 0)
 				break;
-			memcpy(macstring, line + 20, 17);
-			macstring[17] = '\0';
-			if ((lease = find_lease(&addr)) != NULL)
-				lease->ethernet = xstrdup(macstring);
+			if (MAC_STRING_LEN < len)
+				len = MAC_STRING_LEN;
+			memcpy(seg->ethernet, p + plen[PREFIX_HARDWARE_ETHERNET], len);
+			seg->ethernet[len] = '\0';
+			seg->has_ethernet = 1;
 			break;
 		default:
 			/* do nothing */ ;
 		}
 	}
-#undef HAS_PREFIX
-	free(line);
-	free(ipstring);
-	fclose(dhcpd_leases);
-	return 0;
 }
 
-/*! \brief Keyword search in dhcpd.conf file.
- * \param s A line from the dhcpd.conf file.
- * \return Indicator what configuration was found. */
-static int is_interesting_config_clause(char const *restrict s)
+/*! \brief Number of addresses in the configured ranges.  Overlapping
+ * ranges are counted once.  The ranges must be sorted.
+ * \return Number of addresses. */
+static double range_addresses(void)
 {
-	if (strstr(s, "range"))
-		return ITS_A_RANGE_FIRST_IP;
-	if (strstr(s, "shared-network"))
-		return ITS_A_SHAREDNET;
-	if (config.all_as_shared) {
-		if (strstr(s, "subnet"))
-			return ITS_A_SUBNET;
-		if (strstr(s, "netmask"))
-			return ITS_A_NETMASK;
+	struct range_t span;
+	unsigned int i, n = 0;
+	double size = 0;
+
+	for (i = 0; i < num_ranges; i++) {
+		if (ipcomp(&ranges[i].last_ip, &ranges[i].first_ip) < 0)
+			continue;
+		if (n && ipcomp(&ranges[i].first_ip, &span.last_ip) <= 0) {
+			if (0 < ipcomp(&ranges[i].last_ip, &span.last_ip))
+				copy_ipaddr(&span.last_ip, &ranges[i].last_ip);
+			continue;
+		}
+		if (n)
+			size += get_range_size(&span);
+		span = ranges[i];
+		n++;
 	}
-	if (strstr(s, "include"))
-		return ITS_AN_INCLUCE;
-	return ITS_NOTHING_INTERESTING;
+	if (n)
+		size += get_range_size(&span);
+	return size;
 }
 
-/*! \brief Flip first and last IP in range if they are in unusual order.
- */
-static void reorder_last_first(struct range_t *range_p)
+/*! \brief Find the last line that begins a lease block.  The search
+ * looks for the first letter of lease keyword rather than new lines,
+ * because it is much less frequent.
+ * \param map Beginning of the buffer.
+ * \param end Search end position.
+ * \return Beginning of the lease block, or map. */
+static const char *prev_lease_block(const char *map, const char *end)
 {
-	if (ipcomp(&range_p->first_ip, &range_p->last_ip) > 0) {
-		union ipaddr_t tmp;
+	const int c = config.ip_version == IPv4 ? 'l' : 'i';
+	const size_t indent = config.ip_version == IPv4 ? 0 : 2;
+	const char *p = end;
 
-		tmp = range_p->first_ip;
-		range_p->first_ip = range_p->last_ip;
-		range_p->last_ip = tmp;
+	while (map + indent < p && (p = memrchr(map + indent, c, p - map - indent)) != NULL) {
+		const char *line = p - indent;
+
+		if ((line == map || line[-1] == '\n') && is_lease_block(line, end))
+			return line;
 	}
+	return map;
 }
 
-/*! \brief The dhcpd.conf file parser.
- * FIXME: This spaghetti monster function need to be rewrote at least
- * ones.
- */
-void parse_config(int is_include, const char *restrict config_file,
-		  struct shared_network_t *restrict shared_p)
+/*! \brief Parse lease file from the end to the beginning.  The lease
+ * file is a journal, so the first binding state found for an address is
+ * the one in effect, and older blocks of the same address are ignored.
+ * When lease details or leases outside of ranges are not printed the
+ * parsing stops as soon as every address in the configured ranges has a
+ * state.
+ * \param lx The parser state.
+ * \param map Beginning of the lease file.
+ * \param end End of the lease file. */
+static void parse_leases_backwards(struct lease_lexer *restrict lx, const char *map,
+				   const char *end)
 {
-	FILE *dhcpd_config;
-	int newclause = 1, comment = 0, one_ip_range = 0; /* booleans */
-	int quote = 0, braces = 0, argument = ITS_NOTHING_INTERESTING;
-	size_t i = 0;
-	char *word;
-	int braces_shared = 1000;
-	union ipaddr_t addr;
-	struct range_t *range_p = NULL;
-
-	word = xmalloc(sizeof(char) * MAXLEN);
-	if (is_include)
-		/* Default place holder for ranges "All networks". */
-		shared_p->name = shared_networks->name;
-	/* Open configuration file */
-	dhcpd_config = fopen(config_file, "r");
-	if (dhcpd_config == NULL)
-		error(EXIT_FAILURE, errno, "parse_config: %s", config_file);
-#ifdef HAVE_POSIX_FADVISE
-# ifdef POSIX_FADV_SEQUENTIAL
-	if (posix_fadvise(fileno(dhcpd_config), 0, 0, POSIX_FADV_SEQUENTIAL) != 0)
-		error(EXIT_FAILURE, errno, "parse_config: fadvise %s", config_file);
-# endif				/* POSIX_FADV_SEQUENTIAL */
-#endif				/* HAVE_POSIX_FADVISE */
-	/* Very hairy stuff begins. */
-	while (unlikely(!feof(dhcpd_config))) {
-		char c;
-
-		c = fgetc(dhcpd_config);
-		/* Certain characters are magical */
-		switch (c) {
-			/* Handle comments if they are not quoted */
-		case '#':
-			if (quote == 0)
-				comment = 1;
-			continue;
-		case '"':
-			if (comment == 0) {
-				quote++;
-				/* Either one or zero */
-				quote = quote % 2;
-			}
-			continue;
-		case '\n':
-			/* New line resets comment section, but
-			 * not if quoted */
-			if (quote == 0)
-				comment = 0;
-			break;
-		case ';':
-			/* Quoted colon does not mean new clause */
-			if (0 < quote)
-				break;
-			if (comment == 0
-			    && argument != ITS_A_RANGE_FIRST_IP
-			    && argument != ITS_A_RANGE_SECOND_IP && argument != ITS_AN_INCLUCE) {
-				newclause = 1;
-				i = 0;
-			} else if (argument == ITS_A_RANGE_FIRST_IP && one_ip_range == 1) {
-				argument = ITS_A_RANGE_SECOND_IP;
-				c = ' ';
-			} else if (argument == ITS_A_RANGE_SECOND_IP && 0 < i) {
-				/* Range ends to ; and this hair in code
-				 * make two ranges wrote together like...
-				 *
-				 * range 10.20.30.40 10.20.30.41;range 10.20.30.42 10.20.30.43;
-				 *
-				 * ...to be interpreted correctly. */
-				c = ' ';
-				break;
-			} else if (argument == ITS_A_RANGE_SECOND_IP && i == 0) {
-				if (!range_p) {
-					long int pos;
-					pos = ftell(dhcpd_config);
-					error(EXIT_FAILURE, 0, "parse_config: parsing failed at position: %ld", pos);
-				}
-				range_p->last_ip = range_p->first_ip;
-				goto newrange;
-			}
-			continue;
-		case '{':
-			if (0 < quote)
-				break;
-			if (comment == 0)
-				braces++;
-			/* i == 0 detects word that ends to brace like:
-			 *
-			 * shared-network DSL{ ... */
-			if (i == 0) {
-				newclause = 1;
+	struct lease_segment seg;
+	struct leases_t *lease;
+	const unsigned int *members;
+	double unresolved;
+	const char *seg_begin, *seg_end = end;
+	int found;
+
+	unresolved = range_addresses();
+	if (config.print_mac_addreses || config.print_outside)
+		/* leases outside of ranges are needed */
+		unresolved = -1;
+	while (map < seg_end && unresolved != 0) {
+		seg_begin = prev_lease_block(map, seg_end);
+		parse_lease_segment(&seg, seg_begin, seg_end, lx);
+		seg_end = seg_begin;
+		if (lx->states != NULL) {
+			if (seg.type == NOSTATE)
 				continue;
-			} else
-				break;
-		case '}':
-			if (0 < quote)
-				break;
-			if (comment == 0) {
-				braces--;
-				/* End of shared-network */
-				if (braces_shared == braces) {
-					/* FIXME: Using 1000 is lame, but
-					 * works. */
-					braces_shared = 1000;
-					shared_p = shared_networks;
-				}
-				/* Not literally 1, but works for this
-				 * program */
-				newclause = 1;
-			}
+			found = set_range_state(lx->states, &seg.addr, seg.type, 0);
+			if (found < 0 && find_lease(lx->table, &seg.addr) == NULL)
+				add_lease(lx->table, &seg.addr, seg.type);
+			else if (0 < found && 0 < unresolved)
+				unresolved--;
 			continue;
-		default:
-			break;
 		}
-		/* Either inside comment or Nth word of clause. */
-		if (comment == 1 || (newclause == 0 && argument == ITS_NOTHING_INTERESTING))
+		lease = find_lease(lx->table, &seg.addr);
+		if (seg.type == NOSTATE) {
+			/* ethernet of a state that is in an older block */
+			if (seg.has_ethernet && lease == NULL) {
+				lease = add_lease(lx->table, &seg.addr, NOSTATE);
+				set_lease_ethernet(lx->table, lease, seg.ethernet,
+						   strlen(seg.ethernet));
+			}
 			continue;
-		/* Strip white spaces before new clause word. */
-		if ((newclause == 1 || argument != ITS_NOTHING_INTERESTING)
-		    && isspace(c) && i == 0 && one_ip_range == 0)
+		}
+		if (lease != NULL && lease->type != NOSTATE)
 			continue;
-		/* Save to word which clause this is. */
-		if ((newclause == 1 || argument != ITS_NOTHING_INTERESTING)
-		    && (!isspace(c) || 0 < quote)) {
-			word[i] = c;
-			i++;
-			/* Long word which is almost causing overflow. None
-			 * of words are this long which the program is
-			 * searching. */
-			if (MAXLEN == i) {
-				newclause = 0;
-				i = 0;
-				continue;
-			}
+		if (lease != NULL)
+			lease->type = seg.type;
+		else {
+			lease = add_lease(lx->table, &seg.addr, seg.type);
+			if (seg.has_ethernet)
+				set_lease_ethernet(lx->table, lease, seg.ethernet,
+						   strlen(seg.ethernet));
+		}
+		if (0 < unresolved && find_ranges(&seg.addr, &members))
+			unresolved--;
+	}
+	prune_leases(lx->table, NOSTATE);
+}
+
+/*! \brief Parse lease file that is mapped to memory.  The whole file is
+ * scanned in place, so there are no copies per line and no line length
+ * limit.  With a state file only the part appended after previous run is
+ * parsed.
+ * \param lx The parser state.
+ * \param fd File descriptor of the lease file.
+ * \param st Status of the lease file.
+ * \return Zero when the file was parsed, -1 if mapping failed and the
+ * caller should fall back to stdio. */
+static int parse_leases_mmap(struct lease_lexer *restrict lx, const int fd,
+			     const struct stat *st)
+{
+	const size_t size = st->st_size;
+	const char *map, *p, *end;
+	unsigned int backups_found = 0;
+
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		return -1;
+	p = map;
+	end = map + size;
+	if (config.state_file[0]) {
+		p += load_lease_state(st, map, size, &lx->addr, &backups_found);
+		lx->backups_found = backups_found;
+	} else if (config.scan_backwards && config.ip_version != IPvUNKNOWN && lx->use_ranges) {
+		parse_leases_backwards(lx, map, end);
+		munmap((void *)map, size);
+		return 0;
+	}
+# ifdef HAVE_MADVISE
+	madvise((void *)p, end - p, MADV_SEQUENTIAL);
+# endif
+# ifdef HAVE_PTHREAD_H
+	if (1 < config.jobs && p < end) {
+		if (p == map) {
+			/* The first line may determine IP version, that is
+			 * needed to find where the file can be split.  */
+			const char *nl = memchr(map, '\n', size);
+
+			if (nl == NULL)
+				nl = end;
+			parse_lease_line(map, nl - map, lx);
+			p = nl < end ? nl + 1 : end;
 		}
-		/* See if clause is something that parser is looking for. */
-		else if (newclause == 1) {
-			/* Insert string end & set state */
-			word[i] = '\0';
-			if (word[i - 1] != '{')
-				newclause = 0;
-			i = 0;
-			argument = is_interesting_config_clause(word);
-			if (argument == ITS_A_RANGE_FIRST_IP)
-				one_ip_range = 1;
+		if (p < end)
+			parse_lease_buffer_parallel(lx, p, end);
+	} else
+# endif
+	if (p < end)
+		parse_lease_buffer(lx, p, end);
+	if (config.state_file[0])
+		save_lease_state(st, map, size, &lx->addr, lx->backups_found);
+	munmap((void *)map, size);
+	return 0;
+}
+#endif				/* HAVE_MMAP */
+
+/*! \brief Lease file parser.  The parser can only read ISC DHCPD
+ * dhcpd.leases file format.  Regular files are mapped to memory, pipes
+ * and compressed files are streamed, and if neither works the file is
+ * read with stdio.  Lease file name - means standard input.
+ * \param use_ranges False when dhcpd.conf is parsed at the same time,
+ * and the ranges cannot be used to speed up the parsing. */
+int parse_leases(const int use_ranges)
+{
+	FILE *dhcpd_leases;
+	char *line;
+	struct lease_lexer lx;
+	struct stat lease_file_stats;
+	struct lease_source *src;
+
+	if (strcmp(config.dhcpdlease_file, "-") == 0)
+		dhcpd_leases = stdin;
+	else
+		dhcpd_leases = fopen(config.dhcpdlease_file, "r");
+	if (dhcpd_leases == NULL)
+		error(EXIT_FAILURE, errno, "parse_leases: %s", config.dhcpdlease_file);
+	if (fstat(fileno(dhcpd_leases), &lease_file_stats))
+		error(EXIT_FAILURE, errno, "parse_leases: %s", config.dhcpdlease_file);
+	prepare_lease_lexer();
+	init_lease_lexer(&lx, &leases);
+	lx.use_ranges = use_ranges;
+	lx.states = use_ranges ? init_range_states() : NULL;
+	if (lx.states == NULL && S_ISREG(lease_file_stats.st_mode)
+	    && (uintmax_t)lease_file_stats.st_size <= SIZE_MAX)
+		init_lease_table(&leases, expected_leases(lease_file_stats.st_size, use_ranges));
+	if (!S_ISREG(lease_file_stats.st_mode)
+	    || lease_file_is_compressed(fileno(dhcpd_leases))) {
+		src = open_lease_source(fileno(dhcpd_leases), config.dhcpdlease_file);
+		parse_leases_stream(&lx, src);
+		close_lease_source(src);
+		fclose(dhcpd_leases);
+		config.backups_found |= lx.backups_found;
+		return 0;
+	}
+#ifdef HAVE_MMAP
+	if (0 < lease_file_stats.st_size
+	    && (uintmax_t)lease_file_stats.st_size <= SIZE_MAX
+	    && parse_leases_mmap(&lx, fileno(dhcpd_leases), &lease_file_stats) == 0) {
+		fclose(dhcpd_leases);
+		config.backups_found |= lx.backups_found;
+		return 0;
+	}
+#endif
+#ifdef HAVE_POSIX_FADVISE
+# ifdef POSIX_FADV_SEQUENTIAL
+	if (posix_fadvise(fileno(dhcpd_leases), 0, 0, POSIX_FADV_SEQUENTIAL) != 0)
+		error(EXIT_FAILURE, errno, "parse_leases: fadvise %s", config.dhcpdlease_file);
+# endif				/* POSIX_FADV_SEQUENTIAL */
+#endif				/* HAVE_POSIX_FADVISE */
+	line = xmalloc(sizeof(char) * MAXLEN);
+	line[0] = '\0';
+	while (!feof(dhcpd_leases)) {
+		if (!fgets(line, MAXLEN, dhcpd_leases) && ferror(dhcpd_leases))
+			error(EXIT_FAILURE, errno, "parse_leases: %s", config.dhcpdlease_file);
+		parse_lease_line(line, strlen(line), &lx);
+	}
+	free(line);
+	fclose(dhcpd_leases);
+	config.backups_found |= lx.backups_found;
+	return 0;
+}
+
+/*! \brief Find out IP version of the lease file from the first lease
+ * block, without parsing the file.  Only the beginning of a regular file
+ * that is not compressed is looked at.
+ * \return IPv4, IPv6, or IPvUNKNOWN when the version is not clear. */
+int sniff_lease_version(void)
+{
+	char *buf;
+	const char *p, *end;
+	ssize_t len;
+	struct stat st;
+	int fd, version = IPvUNKNOWN;
+
+	if (strcmp(config.dhcpdlease_file, "-") == 0)
+		return IPvUNKNOWN;
+	fd = open(config.dhcpdlease_file, O_RDONLY);
+	if (fd < 0)
+		return IPvUNKNOWN;
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) || lease_file_is_compressed(fd)) {
+		close(fd);
+		return IPvUNKNOWN;
+	}
+	buf = xmalloc(LEASE_SNIFF_BYTES);
+	len = pread(fd, buf, LEASE_SNIFF_BYTES, 0);
+	close(fd);
+	for (p = buf, end = buf + (0 < len ? len : 0); p < end; p++) {
+		if (6 <= end - p && !memcmp(p, "lease ", 6)) {
+			version = IPv4;
+			break;
 		}
-		/* words after range, shared-network or include */
-		else if (argument != ITS_NOTHING_INTERESTING) {
-			word[i] = '\0';
-			newclause = 0;
-			i = 0;
-
-			switch (argument) {
-			case ITS_A_RANGE_SECOND_IP:
-				/* printf ("range 2nd ip: %s\n", word); */
-				range_p = ranges + num_ranges;
-				argument = ITS_NOTHING_INTERESTING;
-				parse_ipaddr(word, &addr);
-				if (one_ip_range == 1) {
-					one_ip_range = 0;
-					copy_ipaddr(&range_p->first_ip, &addr);
-				}
-				copy_ipaddr(&range_p->last_ip, &addr);
-				reorder_last_first(range_p);
- newrange:
-				range_p->count = 0;
-				range_p->touched = 0;
-				range_p->backups = 0;
-				range_p->shared_net = shared_p;
-				num_ranges++;
-				if (RANGES < num_ranges + 1) {
-					RANGES *= 2;
-					ranges = xrealloc(ranges, sizeof(struct range_t) * RANGES);
-					range_p = ranges + num_ranges;
-				}
-				newclause = 1;
-				break;
-			case ITS_A_RANGE_FIRST_IP:
-				/* printf ("range 1nd ip: %s\n", word); */
-				range_p = ranges + num_ranges;
-				if (!(parse_ipaddr(word, &addr)))
-					/* word was not ip, try again */
-					break;
-				copy_ipaddr(&range_p->first_ip, &addr);
-				one_ip_range = 0;
-				argument = ITS_A_RANGE_SECOND_IP;
-				break;
-			case ITS_A_SHAREDNET:
-			case ITS_A_SUBNET:
-				/* ignore subnets inside a shared-network */
-				if (argument == ITS_A_SUBNET && shared_p != shared_networks) {
-					argument = ITS_NOTHING_INTERESTING;
-					break;
-				}
-				/* printf ("shared-network named: %s\n", word); */
-				num_shared_networks++;
-				shared_p = shared_networks + num_shared_networks;
-				shared_p->name = xstrdup(word);
-				shared_p->available = 0;
-				shared_p->used = 0;
-				shared_p->touched = 0;
-				shared_p->backups = 0;
-				shared_p->netmask = (argument == ITS_A_SUBNET ? -1 : 0); /* do not fill in netmask */
-				if (SHARED_NETWORKS < num_shared_networks + 2)
-					/* FIXME: make this to go away by reallocating more space. */
-					error(EXIT_FAILURE, 0,
-					      "parse_config: increase default.h SHARED_NETWORKS and recompile");
-				/* record network's mask too */
-				if (argument == ITS_A_SUBNET)
-				        newclause = 1;
-				argument = ITS_NOTHING_INTERESTING;
-				braces_shared = braces;
-				break;
-			case ITS_A_NETMASK:
-				/* fill in only when requested to do so */
-				if (shared_p->netmask) {
-					if (!(parse_ipaddr(word, &addr)))
-						break;
-					shared_p->netmask = 32;
-					while ((addr.v4 & 0x01) == 0) {
-						addr.v4 >>= 1;
-						shared_p->netmask--;
-					}
-					snprintf(word, MAXLEN-1, "%s/%d", shared_p->name, shared_p->netmask);
-					if (shared_p->name)
-						free(shared_p->name);
-					shared_p->name = xstrdup(word);
-				}
-				argument = ITS_NOTHING_INTERESTING;
-				braces_shared = braces;
-				break;
-			case ITS_AN_INCLUCE:
-				/* printf ("include file: %s\n", word); */
-				argument = ITS_NOTHING_INTERESTING;
-				parse_config(0, word, shared_p);
-				newclause = 1;
-				break;
-			case ITS_NOTHING_INTERESTING:
-				/* printf ("nothing interesting: %s\n", word); */
-				argument = ITS_NOTHING_INTERESTING;
-				break;
-			default:
-				puts("impossible occurred, report a bug");
-				abort();
-			}
+		if (3 <= end - p && !memcmp(p, "ia-", 3)) {
+			version = IPv6;
+			break;
 		}
+		p = memchr(p, '\n', end - p);
+		if (p == NULL)
+			break;
 	}
-	free(word);
-	fclose(dhcpd_config);
-	return;
+	free(buf);
+	return version;
 }
@@ -34,105 +34,675 @@
  */
 
 /*! \file hash.c
- * \brief The leases hash functions. The hash sorting is key to make
- * analysis happen as quick as possible..
+ * \brief The leases hash functions.  Leases are kept in a flat open
+ * addressing table with linear probing, so that a lease costs no separate
+ * allocation and a state change updates the lease in place.  Before
+ * analysis the table is turned to an array sorted by IP.
  */
 
 #include <config.h>
 
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
 #include "xalloc.h"
 
 #include "dhcpd-pools.h"
+#include "defaults.h"
+
+/*! \brief Hash an IPv4 address.  Fibonacci hashing takes the high bits
+ * of the product, so that all bits of the address affect the slot.
+ * \param addr Binary IP.
+ * \param shift Bits to shift away from a 64 bit hash.
+ * \return Home slot of the address. */
+static inline size_t hash_v4(const union ipaddr_t *addr, const unsigned int shift)
+{
+	return ((uint64_t)addr->v4 * UINT64_C(0x9e3779b97f4a7c15)) >> shift;
+}
+
+/*! \brief Hash an IPv6 address.
+ * \param addr Binary IP.
+ * \param shift Bits to shift away from a 64 bit hash.
+ * \return Home slot of the address. */
+static inline size_t hash_v6(const union ipaddr_t *addr, const unsigned int shift)
+{
+	uint64_t a, b;
+
+	memcpy(&a, addr->v6, sizeof(a));
+	memcpy(&b, addr->v6 + sizeof(a), sizeof(b));
+	a = a * UINT64_C(0x9e3779b97f4a7c15) + b;
+	a ^= a >> 32;
+	return (a * UINT64_C(0xff51afd7ed558ccd)) >> shift;
+}
+
+/*! \brief Find the slot of an address, or the empty slot where it
+ * belongs.  The table must not be full.
+ * \param table The leases hash.
+ * \param addr Binary IP.
+ * \return A slot of the table. */
+static inline struct leases_t *probe_v4(const struct lease_table *table,
+					const union ipaddr_t *addr)
+{
+	const size_t mask = table->size - 1;
+	size_t i = hash_v4(addr, table->shift);
+
+	while (table->slots[i].in_use && table->slots[i].ip.v4 != addr->v4)
+		i = (i + 1) & mask;
+	return table->slots + i;
+}
+
+static inline struct leases_t *probe_v6(const struct lease_table *table,
+					const union ipaddr_t *addr)
+{
+	const size_t mask = table->size - 1;
+	size_t i = hash_v6(addr, table->shift);
+
+	while (table->slots[i].in_use
+	       && memcmp(table->slots[i].ip.v6, addr->v6, sizeof(addr->v6)))
+		i = (i + 1) & mask;
+	return table->slots + i;
+}
+
+/*! \brief Home slot of an address in the current IP version.
+ * \param table The leases hash.
+ * \param addr Binary IP.
+ * \return Home slot of the address. */
+static size_t lease_home(const struct lease_table *table, const union ipaddr_t *addr)
+{
+	if (config.ip_version == IPv4)
+		return hash_v4(addr, table->shift);
+	return hash_v6(addr, table->shift);
+}
 
-#define HASH_FIND_V6(head, findv6, out) HASH_FIND(hh, head, findv6, 16, out)
-#define HASH_ADD_V6(head, v6field, add) HASH_ADD(hh, head, v6field, 16, add)
+/*! \brief Change size of leases hash, and move the leases to their new
+ * slots.
+ * \param table The leases hash.
+ * \param size New number of slots, a power of two. */
+static void resize_lease_table(struct lease_table *table, size_t size)
+{
+	struct lease_table new = *table;
+	size_t i;
+
+	new.slots = xcalloc(size, sizeof(struct leases_t));
+	new.size = size;
+	for (new.shift = 64; 1 < size; size >>= 1)
+		new.shift--;
+	for (i = 0; i < table->size; i++) {
+		if (!table->slots[i].in_use)
+			continue;
+		if (config.ip_version == IPv4)
+			*probe_v4(&new, &table->slots[i].ip) = table->slots[i];
+		else
+			*probe_v6(&new, &table->slots[i].ip) = table->slots[i];
+	}
+	free(table->slots);
+	*table = new;
+}
+
+/*! \brief Allocate leases hash for an expected number of leases, so that
+ * the table does not need to grow while the lease file is parsed.
+ * \param table The leases hash, that must be empty.
+ * \param num Expected number of leases. */
+void init_lease_table(struct lease_table *table, size_t num)
+{
+	size_t size = LEASE_TABLE_MIN;
+
+	/* keep load factor at most one half */
+	while (size / 2 < num)
+		size <<= 1;
+	free(table->slots);
+	free(table->strings);
+	memset(table, 0, sizeof(struct lease_table));
+	resize_lease_table(table, size);
+}
+
+/*! \brief Make room for one more lease.
+ * \param table The leases hash. */
+static inline void reserve_lease(struct lease_table *table)
+{
+	if (table->size / 2 < table->count + 1)
+		resize_lease_table(table, table->size ? table->size * 2 : LEASE_TABLE_MIN);
+}
 
-/*! \brief Add a lease to hash array.
+/*! \brief Add a lease to hash array.  If the IP is already in the hash
+ * the lease is updated in place, and it loses the ethernet address.
+ * \param table The leases hash.
  * \param addr Binary IP to be added in leases hash.
- * \param type Lease state of the IP. */
-void add_lease_init(union ipaddr_t *addr
-		    __attribute__ ((unused)), enum ltype type __attribute__ ((unused)))
+ * \param type Lease state of the IP.
+ * \return The lease. */
+struct leases_t *add_lease_init(struct lease_table *table __attribute__ ((unused)),
+				union ipaddr_t *addr __attribute__ ((unused)),
+				enum ltype type __attribute__ ((unused)))
 {
+	return NULL;
 }
 
-void add_lease_v4(union ipaddr_t *addr, enum ltype type)
+struct leases_t *add_lease_v4(struct lease_table *table, union ipaddr_t *addr, enum ltype type)
 {
 	struct leases_t *l;
 
-	l = xmalloc(sizeof(struct leases_t));
-	copy_ipaddr(&l->ip, addr);
+	reserve_lease(table);
+	l = probe_v4(table, addr);
+	if (!l->in_use) {
+		l->ip.v4 = addr->v4;
+		l->in_use = 1;
+		table->count++;
+	}
 	l->type = type;
-	HASH_ADD_INT(leases, ip.v4, l);
-	l->ethernet = NULL;
+	l->ethernet_type = l->ethernet_type == ETHERNET_STRING ? ETHERNET_SPARE : ETHERNET_NONE;
+	return l;
 }
 
-void add_lease_v6(union ipaddr_t *addr, enum ltype type)
+struct leases_t *add_lease_v6(struct lease_table *table, union ipaddr_t *addr, enum ltype type)
 {
 	struct leases_t *l;
 
-	l = xmalloc(sizeof(struct leases_t));
-	copy_ipaddr(&l->ip, addr);
+	reserve_lease(table);
+	l = probe_v6(table, addr);
+	if (!l->in_use) {
+		memcpy(l->ip.v6, addr->v6, sizeof(addr->v6));
+		l->in_use = 1;
+		table->count++;
+	}
 	l->type = type;
-	HASH_ADD_V6(leases, ip.v6, l);
-	l->ethernet = NULL;
+	l->ethernet_type = l->ethernet_type == ETHERNET_STRING ? ETHERNET_SPARE : ETHERNET_NONE;
+	return l;
 }
 
 /*! \brief Find pointer to lease from hash array.
+ * \param table The leases hash.
  * \param addr Binary IP searched from leases hash.
  * \return A lease structure about requested IP, or NULL.
  */
-struct leases_t *find_lease_init(union ipaddr_t *addr __attribute__ ((unused)))
+struct leases_t *find_lease_init(struct lease_table *table __attribute__ ((unused)),
+				 union ipaddr_t *addr __attribute__ ((unused)))
 {
 	return NULL;
 }
 
-struct leases_t *find_lease_v4(union ipaddr_t *addr)
+struct leases_t *find_lease_v4(struct lease_table *table, union ipaddr_t *addr)
 {
 	struct leases_t *l;
 
-	HASH_FIND_INT(leases, &addr->v4, l);
-	return l;
+	if (table->count == 0)
+		return NULL;
+	l = probe_v4(table, addr);
+	return l->in_use ? l : NULL;
 }
 
-struct leases_t *find_lease_v6(union ipaddr_t *addr)
+struct leases_t *find_lease_v6(struct lease_table *table, union ipaddr_t *addr)
 {
 	struct leases_t *l;
 
-	HASH_FIND_V6(leases, &addr->v4, l);
-	return l;
+	if (table->count == 0)
+		return NULL;
+	l = probe_v6(table, addr);
+	return l->in_use ? l : NULL;
 }
 
-/*! \brief Delete a lease from hash array.
- * \param lease Pointer to lease hash. */
-void delete_lease(struct leases_t *lease)
+/*! \brief Value of a hexadecimal digit.
+ * \param c A lower case hexadecimal digit.
+ * \return Value of the digit, or -1 if c is not one. */
+static inline int mac_digit(const char c)
 {
-	free(lease->ethernet);
-	HASH_DEL(leases, lease);
-	free(lease);
+	if ('0' <= c && c <= '9')
+		return c - '0';
+	if ('a' <= c && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
 }
 
-/*! \brief Delete all leases from hash array. */
-#ifdef HASH_ITER
-void delete_all_leases(void)
+/*! \brief Parse a hardware ethernet address in the form dhcpd writes
+ * it, that is six colon separated two digit lower case hexadecimal
+ * numbers.  Such an address prints back exactly the same.
+ * \param mac The address.
+ * \param len Length of the address.
+ * \param dst Output of the binary address.
+ * \return Zero on success, -1 when the address is in other form. */
+static int parse_mac(const char *restrict mac, const size_t len, unsigned char *restrict dst)
 {
-	struct leases_t *l, *tmp;
+	int i, hi, lo;
 
-	HASH_ITER(hh, leases, l, tmp) {
-		free(l->ethernet);
-		HASH_DEL(leases, l);
-		free(l);
+	if (len != MAC_STRING_LEN)
+		return -1;
+	for (i = 0; i < 6; i++) {
+		hi = mac_digit(mac[i * 3]);
+		lo = mac_digit(mac[i * 3 + 1]);
+		if (hi < 0 || lo < 0 || (i < 5 && mac[i * 3 + 2] != ':'))
+			return -1;
+		dst[i] = hi << 4 | lo;
 	}
+	return 0;
 }
-#else
-void delete_all_leases(void)
+
+/*! \brief Save string to the leases hash string area.  Room for at
+ * least MAC_STRING_LEN characters is reserved, so that any later address
+ * of the lease fits in the same place.
+ * \param table The leases hash.
+ * \param str The string.
+ * \param len Length of the string.
+ * \return Offset of the string in table->strings. */
+static uint32_t add_lease_string(struct lease_table *table, const char *str, const size_t len)
+{
+	const size_t offset = table->strings_len;
+	const size_t room = len < MAC_STRING_LEN ? MAC_STRING_LEN : len;
+
+	if (UINT32_MAX - offset <= room)
+		error(EXIT_FAILURE, 0, "add_lease_string: too many strings");
+	if (table->strings_size < offset + room + 1) {
+		table->strings_size = table->strings_size ? table->strings_size : 256;
+		while (table->strings_size < offset + room + 1)
+			table->strings_size *= 2;
+		table->strings = xrealloc(table->strings, table->strings_size);
+	}
+	memcpy(table->strings + offset, str, len);
+	memset(table->strings + offset + len, '\0', room + 1 - len);
+	table->strings_len += room + 1;
+	return offset;
+}
+
+/*! \brief Save hardware ethernet address string of a lease.  The string
+ * of an earlier address of the lease is overwritten when the new one
+ * fits, so that updates of a lease do not grow the string area.  See
+ * add_lease_string() for the room of a string.
+ * \param table The leases hash.
+ * \param lease The lease.
+ * \param str The address.
+ * \param len Length of the address. */
+static void set_lease_string(struct lease_table *table, struct leases_t *lease,
+			     const char *str, const size_t len)
+{
+	char *old;
+
+	if (lease->ethernet_type == ETHERNET_STRING || lease->ethernet_type == ETHERNET_SPARE) {
+		old = table->strings + lease->ethernet.string;
+		if (len <= MAC_STRING_LEN || len <= strlen(old)) {
+			memcpy(old, str, len);
+			old[len] = '\0';
+			lease->ethernet_type = ETHERNET_STRING;
+			return;
+		}
+	}
+	lease->ethernet.string = add_lease_string(table, str, len);
+	lease->ethernet_type = ETHERNET_STRING;
+}
+
+/*! \brief Set hardware ethernet address of a lease.  An address in the
+ * usual form is stored inline as binary, anything else is kept as a
+ * string.
+ * \param table The leases hash.
+ * \param lease The lease.
+ * \param mac The address as it is in the lease file.
+ * \param len Length of the address. */
+void set_lease_ethernet(struct lease_table *table, struct leases_t *lease,
+			const char *mac, size_t len)
 {
-	while (leases) {
-		struct leases_t *l;
+	const char *nul = memchr(mac, '\0', len);
 
-		l = leases;
-		free(l->ethernet);
-		HASH_DEL(leases, l);	/* leases advances to next on delete */
-		free(l);
+	if (nul != NULL)
+		len = nul - mac;
+	if (parse_mac(mac, len, lease->ethernet.binary) == 0) {
+		lease->ethernet_type = ETHERNET_BINARY;
+		return;
 	}
+	set_lease_string(table, lease, mac, len);
+}
+
+/*! \brief Format hardware ethernet address of a lease.
+ * \param table The leases hash.
+ * \param lease The lease.
+ * \param buf Buffer of at least MAC_STRING_LEN + 1 bytes.
+ * \return The address, or an empty string when it is not known. */
+const char *lease_ethernet(const struct lease_table *table, const struct leases_t *lease,
+			   char *buf)
+{
+	static const char digits[] = "0123456789abcdef";
+	char *p = buf;
+	int i;
+
+	switch (lease->ethernet_type) {
+	case ETHERNET_BINARY:
+		for (i = 0; i < 6; i++) {
+			*p++ = digits[lease->ethernet.binary[i] >> 4];
+			*p++ = digits[lease->ethernet.binary[i] & 0xf];
+			*p++ = ':';
+		}
+		p[-1] = '\0';
+		return buf;
+	case ETHERNET_STRING:
+		return table->strings + lease->ethernet.string;
+	default:
+		return "";
+	}
+}
+
+/*! \brief Copy hardware ethernet address from a lease in another hash.
+ * \param table The leases hash of dst.
+ * \param dst The lease to be updated.
+ * \param from The leases hash of src.
+ * \param src The lease to be copied. */
+static void copy_lease_ethernet(struct lease_table *table, struct leases_t *dst,
+				const struct lease_table *from, const struct leases_t *src)
+{
+	const char *str;
+
+	if (src->ethernet_type == ETHERNET_BINARY) {
+		memcpy(dst->ethernet.binary, src->ethernet.binary, sizeof(dst->ethernet.binary));
+		dst->ethernet_type = ETHERNET_BINARY;
+	} else if (src->ethernet_type == ETHERNET_STRING) {
+		str = from->strings + src->ethernet.string;
+		set_lease_string(table, dst, str, strlen(str));
+	} else if (dst->ethernet_type == ETHERNET_STRING)
+		dst->ethernet_type = ETHERNET_SPARE;
+	else if (dst->ethernet_type == ETHERNET_BINARY)
+		dst->ethernet_type = ETHERNET_NONE;
+}
+
+/*! \brief Delete a lease from hash array.  Leases after the deleted one
+ * in the same probe sequence are shifted backwards, so that no deleted
+ * markers are needed.
+ * \param table The leases hash.
+ * \param i Slot of the lease. */
+static void delete_lease_slot(struct lease_table *table, size_t i)
+{
+	const size_t mask = table->size - 1;
+	size_t j = i, home;
+
+	while (1) {
+		j = (j + 1) & mask;
+		if (!table->slots[j].in_use)
+			break;
+		home = lease_home(table, &table->slots[j].ip);
+		/* a lease cannot move before its home slot */
+		if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+			continue;
+		table->slots[i] = table->slots[j];
+		i = j;
+	}
+	table->slots[i].in_use = 0;
+	table->count--;
+}
+
+/*! \brief Delete all leases that are in a given state.
+ * \param table The leases hash.
+ * \param type The lease state to be deleted. */
+void prune_leases(struct lease_table *table, enum ltype type)
+{
+	size_t i = 0;
+
+	while (i < table->size) {
+		/* deletion may move another lease to the same slot */
+		if (table->slots[i].in_use && table->slots[i].type == type)
+			delete_lease_slot(table, i);
+		else
+			i++;
+	}
+}
+
+/*! \brief Move leases from one hash array to another.  A lease replaces
+ * an older entry of the same IP.  A NOSTATE lease only updates ethernet
+ * address of an existing lease.
+ * \param table The leases hash receiving the leases.
+ * \param from The leases hash that will be emptied. */
+void merge_leases(struct lease_table *table, struct lease_table *from)
+{
+	struct leases_t *l, *old;
+	size_t i;
+
+	for (i = 0; i < from->size; i++) {
+		l = from->slots + i;
+		if (!l->in_use)
+			continue;
+		if (l->type == NOSTATE) {
+			old = find_lease(table, &l->ip);
+			if (old != NULL)
+				copy_lease_ethernet(table, old, from, l);
+			continue;
+		}
+		old = add_lease(table, &l->ip, l->type);
+		copy_lease_ethernet(table, old, from, l);
+	}
+	free(from->slots);
+	free(from->strings);
+	memset(from, 0, sizeof(struct lease_table));
+}
+
+/*! \brief Turn digit histograms of radix sort passes to start offsets.
+ * \param count Histograms of passes, 256 counters each.
+ * \param passes Number of passes.
+ * \param n Number of keys.
+ * \param skip Output of passes where every key has the same digit, and
+ * that do not change the order. */
+static void radix_offsets(size_t *count, const unsigned int passes, const size_t n,
+			  unsigned char *skip)
+{
+	size_t sum, c;
+	unsigned int p, d;
+
+	for (p = 0; p < passes; p++) {
+		skip[p] = 0;
+		for (sum = 0, d = 0; d < 256; d++) {
+			c = count[p * 256 + d];
+			if (c == n)
+				skip[p] = 1;
+			count[p * 256 + d] = sum;
+			sum += c;
+		}
+	}
+}
+
+/*! \brief LSD radix sort of 64 bit keys that have an IPv4 address in
+ * the high 32 bits, one byte of address per pass.
+ * \param keys The keys, followed by space for n more keys.
+ * \param n Number of keys.
+ * \return The sorted keys, that are either at keys or at keys + n. */
+static uint64_t *radix_sort_v4(uint64_t *keys, const size_t n)
+{
+	uint64_t *tmp = keys + n, *swap;
+	size_t *count, i;
+	unsigned char skip[4];
+	unsigned int p, d;
+
+	count = xcalloc(4 * 256, sizeof(size_t));
+	for (i = 0; i < n; i++)
+		for (p = 0; p < 4; p++)
+			count[p * 256 + ((keys[i] >> (32 + p * 8)) & 0xff)]++;
+	radix_offsets(count, 4, n, skip);
+	for (p = 0; p < 4; p++) {
+		if (skip[p])
+			continue;
+		for (i = 0; i < n; i++) {
+			d = (keys[i] >> (32 + p * 8)) & 0xff;
+			tmp[count[p * 256 + d]++] = keys[i];
+		}
+		swap = keys;
+		keys = tmp;
+		tmp = swap;
+	}
+	free(count);
+	return keys;
+}
+
+/*! \brief Sort IPv4 leases with LSD radix sort.  The addresses and slot
+ * numbers are packed to 64 bit keys that are sorted, and the leases are
+ * moved to their place once at the end.
+ * \param table Leases hash, that has been compacted. */
+static void sort_leases_v4(struct lease_table *table)
+{
+	const size_t n = table->count;
+	uint64_t *keys, *sorted_keys;
+	struct leases_t *sorted;
+	size_t i;
+
+	keys = xmalloc(sizeof(uint64_t) * n * 2);
+	for (i = 0; i < n; i++)
+		keys[i] = (uint64_t)table->slots[i].ip.v4 << 32 | i;
+	sorted_keys = radix_sort_v4(keys, n);
+	sorted = xmalloc(sizeof(struct leases_t) * n);
+	for (i = 0; i < n; i++)
+		sorted[i] = table->slots[sorted_keys[i] & UINT32_MAX];
+	free(keys);
+	free(table->slots);
+	table->slots = sorted;
+	table->size = n;
+}
+
+/*! \brief Sort IPv6 leases with LSD radix sort, one byte of address per
+ * pass from the last byte.  Addresses usually share a long prefix, and
+ * passes over bytes that are the same in every address are skipped.
+ * \param table Leases hash, that has been compacted. */
+static void sort_leases_v6(struct lease_table *table)
+{
+	const size_t n = table->count;
+	struct leases_t *leases_p, *tmp, *swap;
+	size_t *count, i;
+	unsigned char skip[16];
+	unsigned int p, d;
+
+	tmp = xmalloc(sizeof(struct leases_t) * n);
+	count = xcalloc(16 * 256, sizeof(size_t));
+	leases_p = table->slots;
+	for (i = 0; i < n; i++)
+		for (p = 0; p < 16; p++)
+			count[p * 256 + leases_p[i].ip.v6[15 - p]]++;
+	radix_offsets(count, 16, n, skip);
+	for (p = 0; p < 16; p++) {
+		if (skip[p])
+			continue;
+		for (i = 0; i < n; i++) {
+			d = leases_p[i].ip.v6[15 - p];
+			tmp[count[p * 256 + d]++] = leases_p[i];
+		}
+		swap = leases_p;
+		leases_p = tmp;
+		tmp = swap;
+	}
+	free(tmp);
+	free(count);
+	table->slots = leases_p;
+	table->size = n;
+}
+
+/*! \brief Sorted IPv4 lease columns.  The state is packed below the
+ * address, so the keys are sorted without looking at the leases again.
+ * \param table The leases hash.
+ * \param cols Columns, which arrays are allocated. */
+static void lease_columns_v4(const struct lease_table *table, struct lease_columns *cols)
+{
+	uint64_t *keys, *sorted_keys;
+	size_t i, n = 0;
+
+	keys = xmalloc(sizeof(uint64_t) * table->count * 2);
+	for (i = 0; i < table->size; i++)
+		if (table->slots[i].in_use)
+			keys[n++] = (uint64_t)table->slots[i].ip.v4 << 32 | table->slots[i].type;
+	sorted_keys = radix_sort_v4(keys, n);
+	for (i = 0; i < n; i++) {
+		cols->ips[i].v4 = sorted_keys[i] >> 32;
+		cols->states[i] = sorted_keys[i] & 0xff;
+	}
+	free(keys);
+}
+
+/*! \brief Sorted IPv6 lease columns.  Both columns are moved on every
+ * radix sort pass, see sort_leases_v6().
+ * \param table The leases hash.
+ * \param cols Columns, which arrays are allocated. */
+static void lease_columns_v6(const struct lease_table *table, struct lease_columns *cols)
+{
+	const size_t n = cols->count;
+	union ipaddr_t *ips = cols->ips, *tmp_ips, *swap_ips;
+	unsigned char *states = cols->states, *tmp_states, *swap_states;
+	size_t *count, i, j = 0;
+	unsigned char skip[16];
+	unsigned int p, d;
+
+	for (i = 0; i < table->size; i++)
+		if (table->slots[i].in_use) {
+			ips[j] = table->slots[i].ip;
+			states[j++] = table->slots[i].type;
+		}
+	tmp_ips = xmalloc(sizeof(union ipaddr_t) * n);
+	tmp_states = xmalloc(n);
+	count = xcalloc(16 * 256, sizeof(size_t));
+	for (i = 0; i < n; i++)
+		for (p = 0; p < 16; p++)
+			count[p * 256 + ips[i].v6[15 - p]]++;
+	radix_offsets(count, 16, n, skip);
+	for (p = 0; p < 16; p++) {
+		if (skip[p])
+			continue;
+		for (i = 0; i < n; i++) {
+			d = ips[i].v6[15 - p];
+			tmp_ips[count[p * 256 + d]] = ips[i];
+			tmp_states[count[p * 256 + d]++] = states[i];
+		}
+		swap_ips = ips;
+		ips = tmp_ips;
+		tmp_ips = swap_ips;
+		swap_states = states;
+		states = tmp_states;
+		tmp_states = swap_states;
+	}
+	free(tmp_ips);
+	free(tmp_states);
+	free(count);
+	cols->ips = ips;
+	cols->states = states;
+}
+
+/*! \brief Copy leases to address and state columns sorted by address.
+ * The leases hash is not changed.
+ * \param table The leases hash.
+ * \param cols Output of the columns, to be freed with
+ * free_lease_columns(). */
+void lease_columns(const struct lease_table *table, struct lease_columns *cols)
+{
+	cols->count = table->count;
+	cols->ips = xmalloc(sizeof(union ipaddr_t) * (cols->count + 1));
+	cols->states = xmalloc(cols->count + 1);
+	if (cols->count == 0)
+		return;
+	if (config.ip_version == IPv4)
+		lease_columns_v4(table, cols);
+	else
+		lease_columns_v6(table, cols);
+}
+
+/*! \brief Free lease columns.
+ * \param cols The columns. */
+void free_lease_columns(struct lease_columns *cols)
+{
+	free(cols->ips);
+	free(cols->states);
+	memset(cols, 0, sizeof(struct lease_columns));
+}
+
+/*! \brief Sort leases by IP.  The leases are compacted and radix sorted,
+ * after which the table is an array of table->count leases that can no
+ * longer be searched by IP.
+ * \param table The leases hash. */
+void sort_leases(struct lease_table *table)
+{
+	size_t i, j = 0;
+
+	if (table->count == 0)
+		return;
+	for (i = 0; i < table->size; i++)
+		if (table->slots[i].in_use)
+			table->slots[j++] = table->slots[i];
+	if (config.ip_version == IPv4)
+		sort_leases_v4(table);
+	else
+		sort_leases_v6(table);
+}
+
+/*! \brief Delete all leases from hash array. */
+void delete_all_leases(void)
+{
+	free(leases.slots);
+	free(leases.strings);
+	memset(&leases, 0, sizeof(struct lease_table));
 }
-#endif
@@ -0,0 +1,281 @@
+/*
+ * The dhcpd-pools has BSD 2-clause license which also known as "Simplified
+ * BSD License" or "FreeBSD License".
+ *
+ * Copyright 2006- Sami Kerola. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the
+ *       distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR AND CONTRIBUTORS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing
+ * official policies, either expressed or implied, of Sami Kerola.
+ */
+
+/*! \file index.c
+ * \brief Range index, that finds the ranges an address belongs to
+ * without sorting leases.  Range first addresses, and addresses right
+ * after range last addresses, split the address space to intervals that
+ * do not overlap, and each interval has a list of ranges covering it.
+ * The interval of an IPv4 address is narrowed with a direct table of /16
+ * networks, and for IPv6 with a radix trie of address bytes, before a
+ * binary search.
+ */
+
+#include <config.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xalloc.h"
+
+#include "dhcpd-pools.h"
+#include "defaults.h"
+
+/*! \struct index_node
+ * \brief A radix trie node covering starts[lo] to starts[hi - 1].  The
+ * starts share depth first bytes, and when the node has children they
+ * are selected by byte number depth of an address.
+ */
+struct index_node {
+	unsigned int lo;
+	unsigned int hi;
+	unsigned int depth;
+	struct index_node *child;
+};
+
+/*! \struct range_index
+ * \brief Intervals of the address space.  Interval k begins at
+ * starts[k] and ends before starts[k + 1], and it is covered by ranges
+ * members[cover[k]] to members[cover[k + 1] - 1].
+ */
+struct range_index {
+	union ipaddr_t *starts;
+	unsigned int num_starts;
+	unsigned int *cover;
+	unsigned int *members;
+	unsigned int *v4_table;
+	struct index_node v6_root;
+};
+
+/*! \var range_index
+ * \brief The range index of ranges array. */
+static struct range_index range_index;
+
+/*! \brief Compare IP addresses for qsort.
+ * \param a,b Binary IP addresses.
+ * \return Like strcmp. */
+static int start_comp(const void *restrict a, const void *restrict b)
+{
+	return ipcomp(a, b);
+}
+
+/*! \brief Number of interval starts before an address, within a part of
+ * the starts array.
+ * \param addr Binary IP.
+ * \param lo First start to look at.
+ * \param hi End of starts to look at.
+ * \param inclusive When true starts equal to addr are counted.
+ * \param version The IP version.
+ * \return Index of the first start that is not counted. */
+static _DP_INLINE unsigned int search_starts(const union ipaddr_t *addr, unsigned int lo,
+					     unsigned int hi, const int inclusive,
+					     const enum dhcp_version version)
+{
+	while (lo < hi) {
+		const unsigned int mid = lo + (hi - lo) / 2;
+		const int c = ip_cmp(version, &range_index.starts[mid], addr);
+
+		if (c < 0 || (inclusive && c == 0))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*! \brief Build IPv4 /16 network table.  Starts of network p are from
+ * v4_table[p] to v4_table[p + 1] - 1. */
+static void build_v4_table(void)
+{
+	union ipaddr_t addr;
+	unsigned int p, k = 0;
+
+	range_index.v4_table = xmalloc(sizeof(unsigned int) * (V4_TABLE_SIZE + 1));
+	for (p = 0; p < V4_TABLE_SIZE; p++) {
+		addr.v4 = (uint32_t)p << 16;
+		k = search_starts(&addr, k, range_index.num_starts, 0, IPv4);
+		range_index.v4_table[p] = k;
+	}
+	range_index.v4_table[V4_TABLE_SIZE] = range_index.num_starts;
+}
+
+/*! \brief Build IPv6 radix trie below a node.  Bytes that all starts of
+ * the node share are skipped, so a long common prefix costs a single
+ * node.
+ * \param node A node which lo and hi are set. */
+static void build_v6_trie(struct index_node *node)
+{
+	const unsigned char *first, *last;
+	union ipaddr_t addr;
+	unsigned int c, k;
+
+	if (node->hi - node->lo <= INDEX_LEAF_SIZE)
+		return;
+	first = range_index.starts[node->lo].v6;
+	last = range_index.starts[node->hi - 1].v6;
+	for (node->depth = 0; first[node->depth] == last[node->depth]; node->depth++)
+		/* starts are unique, so they differ somewhere */ ;
+	node->child = arena_alloc(256 * sizeof(struct index_node));
+	memcpy(addr.v6, first, sizeof(addr.v6));
+	memset(addr.v6 + node->depth + 1, 0, sizeof(addr.v6) - node->depth - 1);
+	k = node->lo;
+	for (c = 0; c < 256; c++) {
+		addr.v6[node->depth] = c;
+		k = search_starts(&addr, k, node->hi, 0, IPv6);
+		node->child[c].lo = k;
+		if (0 < c)
+			node->child[c - 1].hi = k;
+	}
+	node->child[255].hi = node->hi;
+	for (c = 0; c < 256; c++)
+		build_v6_trie(node->child + c);
+}
+
+/*! \brief Build the range index.  Must be called after the ranges are
+ * sorted, and before leases are parsed. */
+void build_range_index(void)
+{
+	union ipaddr_t *starts, next;
+	unsigned int i, j, k, a, b, n = 0;
+
+	memset(&range_index, 0, sizeof(range_index));
+	if (num_ranges == 0 || config.ip_version == IPvUNKNOWN)
+		return;
+	starts = xmalloc(sizeof(union ipaddr_t) * num_ranges * 2);
+	for (i = 0; i < num_ranges; i++) {
+		copy_ipaddr(&starts[n++], &ranges[i].first_ip);
+		copy_ipaddr(&next, &ranges[i].last_ip);
+		/* an address right after last ip, unless it would wrap */
+		if (config.ip_version == IPv4) {
+			if (next.v4 == UINT32_MAX)
+				continue;
+			next.v4++;
+		} else {
+			for (j = sizeof(next.v6); 0 < j && next.v6[j - 1] == 0xff; j--)
+				next.v6[j - 1] = 0;
+			if (j == 0)
+				continue;
+			next.v6[j - 1]++;
+		}
+		copy_ipaddr(&starts[n++], &next);
+	}
+	qsort(starts, n, sizeof(union ipaddr_t), start_comp);
+	for (i = 0, k = 0; i < n; i++)
+		if (k == 0 || ipcomp(&starts[k - 1], &starts[i]))
+			copy_ipaddr(&starts[k++], &starts[i]);
+	range_index.starts = starts;
+	range_index.num_starts = k;
+	/* count ranges of each interval, and then list them */
+	range_index.cover = xcalloc(k + 1, sizeof(unsigned int));
+	for (i = 0; i < num_ranges; i++) {
+		a = search_starts(&ranges[i].first_ip, 0, k, 1, config.ip_version) - 1;
+		b = search_starts(&ranges[i].last_ip, a, k, 1, config.ip_version);
+		for (j = a; j < b; j++)
+			range_index.cover[j + 1]++;
+	}
+	for (j = 0; j < k; j++)
+		range_index.cover[j + 1] += range_index.cover[j];
+	range_index.members = xmalloc(sizeof(unsigned int) * (range_index.cover[k] + 1));
+	for (i = 0; i < num_ranges; i++) {
+		a = search_starts(&ranges[i].first_ip, 0, k, 1, config.ip_version) - 1;
+		b = search_starts(&ranges[i].last_ip, a, k, 1, config.ip_version);
+		for (j = a; j < b; j++)
+			range_index.members[range_index.cover[j]++] = i;
+	}
+	/* the fill moved every offset to the next interval */
+	for (j = k; 0 < j; j--)
+		range_index.cover[j] = range_index.cover[j - 1];
+	range_index.cover[0] = 0;
+	if (config.ip_version == IPv4)
+		build_v4_table();
+	else {
+		range_index.v6_root.hi = k;
+		build_v6_trie(&range_index.v6_root);
+	}
+}
+
+/*! \brief Find the ranges an address belongs to.
+ * \param addr Binary IP.
+ * \param members Output of the range array indexes.
+ * \param version The IP version.
+ * \return Number of ranges, zero when the address is outside of all
+ * ranges. */
+static _DP_INLINE unsigned int find_ranges_ipv(const union ipaddr_t *addr,
+					       const unsigned int **members,
+					       const enum dhcp_version version)
+{
+	const struct index_node *node;
+	unsigned int lo, hi, k;
+
+	if (range_index.num_starts == 0)
+		return 0;
+	if (version == IPv4) {
+		lo = range_index.v4_table[addr->v4 >> 16];
+		hi = range_index.v4_table[(addr->v4 >> 16) + 1];
+	} else {
+		node = &range_index.v6_root;
+		while (node->child != NULL
+		       && !memcmp(addr->v6, range_index.starts[node->lo].v6, node->depth))
+			node = node->child + addr->v6[node->depth];
+		lo = node->lo;
+		hi = node->hi;
+	}
+	k = search_starts(addr, lo, hi, 1, version);
+	if (k == 0)
+		return 0;
+	k--;
+	*members = range_index.members + range_index.cover[k];
+	return range_index.cover[k + 1] - range_index.cover[k];
+}
+
+unsigned int find_ranges_v4(const union ipaddr_t *addr, const unsigned int **members)
+{
+	return find_ranges_ipv(addr, members, IPv4);
+}
+
+unsigned int find_ranges_v6(const union ipaddr_t *addr, const unsigned int **members)
+{
+	return find_ranges_ipv(addr, members, IPv6);
+}
+
+/*! \brief Find the ranges an address belongs to, when the caller does
+ * not know the IP version.  See find_ranges_ipv(). */
+unsigned int find_ranges(const union ipaddr_t *addr, const unsigned int **members)
+{
+	if (config.ip_version == IPv4)
+		return find_ranges_v4(addr, members);
+	return find_ranges_v6(addr, members);
+}
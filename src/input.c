@@ -0,0 +1,320 @@
+/*
+ * The dhcpd-pools has BSD 2-clause license which also known as "Simplified
+ * BSD License" or "FreeBSD License".
+ *
+ * Copyright 2006- Sami Kerola. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the
+ *       distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR AND CONTRIBUTORS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing
+ * official policies, either expressed or implied, of Sami Kerola.
+ */
+
+/*! \file input.c
+ * \brief Lease file input streams.  A lease file that cannot be mapped
+ * to memory, such as standard input or a compressed file, is read through
+ * a lease_source.  Compression is recognized from the first bytes of the
+ * data, so compressed data can also come from a pipe.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#ifdef HAVE_ZLIB_H
+# include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD_H
+# include <zstd.h>
+#endif
+
+#include "error.h"
+#include "xalloc.h"
+
+#include "dhcpd-pools.h"
+#include "defaults.h"
+
+/*! \enum lease_compression
+ * \brief Lease file compression formats.
+ */
+enum lease_compression {
+	LEASE_PLAIN,
+	LEASE_GZIP,
+	LEASE_ZSTD
+};
+
+/*! \struct lease_source
+ * \brief Lease file input stream.  The in buffer holds data read from
+ * the file that is not consumed yet.
+ */
+struct lease_source {
+	int fd;
+	const char *name;
+	enum lease_compression type;
+	unsigned char *in;
+	size_t in_size;
+	size_t in_pos;
+	size_t in_len;
+	unsigned int eof:1;
+	unsigned int member_end:1;
+#ifdef HAVE_ZLIB_H
+	z_stream z;
+#endif
+#ifdef HAVE_ZSTD_H
+	ZSTD_DStream *zstd;
+	size_t zstd_hint;
+#endif
+};
+
+/*! \brief Recognize compression format from magic bytes.
+ * \param magic Beginning of the data.
+ * \param len Number of bytes available.
+ * \return Compression format. */
+static enum lease_compression lease_compression(const unsigned char *magic, const size_t len)
+{
+	if (2 <= len && magic[0] == 0x1f && magic[1] == 0x8b)
+		return LEASE_GZIP;
+	if (4 <= len && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f
+	    && magic[3] == 0xfd)
+		return LEASE_ZSTD;
+	return LEASE_PLAIN;
+}
+
+/*! \brief Test if a regular file is compressed.  The file position is
+ * not changed.
+ * \param fd File descriptor of the lease file.
+ * \return True if the file needs to be read with a lease_source. */
+int lease_file_is_compressed(const int fd)
+{
+	unsigned char magic[4];
+	ssize_t len;
+
+	len = pread(fd, magic, sizeof(magic), 0);
+	if (len <= 0)
+		return 0;
+	return lease_compression(magic, len) != LEASE_PLAIN;
+}
+
+/*! \brief Read more compressed data to the in buffer.
+ * \param src The lease source.
+ * \return Number of new bytes, zero at end of file. */
+static ssize_t fill_lease_source(struct lease_source *src)
+{
+	ssize_t len;
+
+	if (src->in_pos == src->in_len)
+		src->in_pos = src->in_len = 0;
+	do
+		len = read(src->fd, src->in + src->in_len, src->in_size - src->in_len);
+	while (len < 0 && errno == EINTR);
+	if (len < 0)
+		error(EXIT_FAILURE, errno, "parse_leases: %s", src->name);
+	if (len == 0)
+		src->eof = 1;
+	src->in_len += len;
+	return len;
+}
+
+/*! \brief Open a lease file input stream.
+ * \param fd File descriptor of the lease file.
+ * \param name Name of the file, for error messages.
+ * \return The lease source. */
+struct lease_source *open_lease_source(const int fd, const char *name)
+{
+	struct lease_source *src;
+
+	src = xcalloc(1, sizeof(struct lease_source));
+	src->fd = fd;
+	src->name = name;
+	src->in_size = LEASE_BUFFER_SIZE;
+	src->in = xcalloc(1, src->in_size);
+	while (src->in_len < 4 && !src->eof)
+		fill_lease_source(src);
+	src->type = lease_compression(src->in, src->in_len);
+	switch (src->type) {
+	case LEASE_PLAIN:
+		break;
+	case LEASE_GZIP:
+#ifdef HAVE_ZLIB_H
+		/* 32 enables gzip header detection */
+		if (inflateInit2(&src->z, 15 + 32) != Z_OK)
+			error(EXIT_FAILURE, 0, "parse_leases: %s: %s", name, src->z.msg);
+		break;
+#else
+		error(EXIT_FAILURE, 0, "parse_leases: %s: gzip support is not compiled in", name);
+#endif
+	case LEASE_ZSTD:
+#ifdef HAVE_ZSTD_H
+		src->zstd = ZSTD_createDStream();
+		if (src->zstd == NULL || ZSTD_isError(ZSTD_initDStream(src->zstd)))
+			error(EXIT_FAILURE, 0, "parse_leases: %s: zstd initialization failed", name);
+		break;
+#else
+		error(EXIT_FAILURE, 0, "parse_leases: %s: zstd support is not compiled in", name);
+#endif
+	}
+	return src;
+}
+
+#ifdef HAVE_ZLIB_H
+/*! \brief Read from gzip compressed lease file.  Concatenated gzip
+ * members are read one after another, and garbage after the last member
+ * is ignored with a warning, like gzip -d does.
+ * \param src The lease source.
+ * \param buf Output buffer.
+ * \param len Size of output buffer.
+ * \return Number of bytes read, zero at end of file. */
+static ssize_t read_gzip(struct lease_source *src, char *buf, const size_t len)
+{
+	int ret;
+
+	src->z.next_out = (unsigned char *)buf;
+	src->z.avail_out = len;
+	while (src->z.avail_out == len) {
+		if (src->in_pos == src->in_len) {
+			if (src->eof || fill_lease_source(src) == 0) {
+				if (src->z.total_in)
+					error(EXIT_FAILURE, 0, "parse_leases: %s: unexpected end of file",
+					      src->name);
+				break;
+			}
+		}
+		src->z.next_in = src->in + src->in_pos;
+		src->z.avail_in = src->in_len - src->in_pos;
+		ret = inflate(&src->z, Z_NO_FLUSH);
+		src->in_pos = src->in_len - src->z.avail_in;
+		if (ret == Z_STREAM_END) {
+			inflateReset(&src->z);
+			src->member_end = 1;
+		} else if (ret == Z_DATA_ERROR && src->member_end) {
+			error(0, 0, "parse_leases: %s: trailing garbage ignored", src->name);
+			inflateReset(&src->z);
+			src->in_pos = src->in_len;
+			src->eof = 1;
+			break;
+		} else if (ret == Z_OK && src->z.total_out)
+			src->member_end = 0;
+		else if (ret != Z_OK && ret != Z_BUF_ERROR)
+			error(EXIT_FAILURE, 0, "parse_leases: %s: %s", src->name,
+			      src->z.msg ? src->z.msg : "gzip data error");
+	}
+	return len - src->z.avail_out;
+}
+#endif				/* HAVE_ZLIB_H */
+
+#ifdef HAVE_ZSTD_H
+/*! \brief Read from zstd compressed lease file.
+ * \param src The lease source.
+ * \param buf Output buffer.
+ * \param len Size of output buffer.
+ * \return Number of bytes read, zero at end of file. */
+static ssize_t read_zstd(struct lease_source *src, char *buf, const size_t len)
+{
+	ZSTD_outBuffer out = { buf, len, 0 };
+	ZSTD_inBuffer in;
+
+	while (out.pos == 0) {
+		if (src->in_pos == src->in_len && !src->eof)
+			fill_lease_source(src);
+		/* zero hint means the last frame is complete */
+		if (src->in_pos == src->in_len && src->zstd_hint == 0)
+			break;
+		in.src = src->in + src->in_pos;
+		in.size = src->in_len - src->in_pos;
+		in.pos = 0;
+		/* at end of file this flushes data the decoder still holds */
+		src->zstd_hint = ZSTD_decompressStream(src->zstd, &out, &in);
+		src->in_pos += in.pos;
+		if (ZSTD_isError(src->zstd_hint))
+			error(EXIT_FAILURE, 0, "parse_leases: %s: %s", src->name,
+			      ZSTD_getErrorName(src->zstd_hint));
+		if (out.pos == 0 && in.size == 0)
+			error(EXIT_FAILURE, 0, "parse_leases: %s: unexpected end of file",
+			      src->name);
+	}
+	return out.pos;
+}
+#endif				/* HAVE_ZSTD_H */
+
+/*! \brief Read decompressed lease file data.
+ * \param src The lease source.
+ * \param buf Output buffer.
+ * \param len Size of output buffer.
+ * \return Number of bytes read, zero at end of file. */
+ssize_t read_lease_source(struct lease_source *src, char *buf, const size_t len)
+{
+	size_t n;
+
+	switch (src->type) {
+#ifdef HAVE_ZLIB_H
+	case LEASE_GZIP:
+		return read_gzip(src, buf, len);
+#endif
+#ifdef HAVE_ZSTD_H
+	case LEASE_ZSTD:
+		return read_zstd(src, buf, len);
+#endif
+	default:
+		break;
+	}
+	if (src->in_pos < src->in_len) {
+		/* bytes that were read to recognize compression */
+		n = src->in_len - src->in_pos < len ? src->in_len - src->in_pos : len;
+		memcpy(buf, src->in + src->in_pos, n);
+		src->in_pos += n;
+		return n;
+	}
+	if (src->eof)
+		return 0;
+	do
+		n = read(src->fd, buf, len);
+	while ((ssize_t)n < 0 && errno == EINTR);
+	if ((ssize_t)n < 0)
+		error(EXIT_FAILURE, errno, "parse_leases: %s", src->name);
+	return n;
+}
+
+/*! \brief Close lease file input stream.  The file descriptor is left
+ * open.
+ * \param src The lease source. */
+void close_lease_source(struct lease_source *src)
+{
+#ifdef HAVE_ZLIB_H
+	if (src->type == LEASE_GZIP)
+		inflateEnd(&src->z);
+#endif
+#ifdef HAVE_ZSTD_H
+	if (src->type == LEASE_ZSTD)
+		ZSTD_freeDStream(src->zstd);
+#endif
+	free(src->in);
+	free(src);
+}
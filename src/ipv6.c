@@ -0,0 +1,177 @@
+/*
+ * The dhcpd-pools has BSD 2-clause license which also known as "Simplified
+ * BSD License" or "FreeBSD License".
+ *
+ * Copyright 2006- Sami Kerola. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the
+ *       distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR AND CONTRIBUTORS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing
+ * official policies, either expressed or implied, of Sami Kerola.
+ */
+
+/*! \file ipv6.c
+ * \brief IPv6 address parser.  The parser accepts exactly the same
+ * strings as inet_pton(AF_INET6), but the address does not need to be
+ * NUL terminated.  This file does not depend on rest of dhcpd-pools, so
+ * that it can be tested alone.
+ */
+
+#include <config.h>
+
+#include <stddef.h>
+#include <string.h>
+
+#include "dhcpd-pools.h"
+
+/*! \brief Value of a hexadecimal digit.
+ * \param c A character.
+ * \return Value of the digit, or -1 if c is not a hexadecimal digit. */
+static inline int hex_digit(const unsigned char c)
+{
+	if ((unsigned int)(c - '0') < 10)
+		return c - '0';
+	if ((unsigned int)((c | 0x20) - 'a') < 6)
+		return (c | 0x20) - 'a' + 10;
+	return -1;
+}
+
+/*! \brief Parse IPv4 address in the end of IPv6 address.  Only four
+ * decimal numbers without leading zeros are accepted.
+ * \param src Beginning of the IPv4 address.
+ * \param end End of the address.
+ * \param dst Four bytes of output.
+ * \return True if the address is valid. */
+static int parse_ipv6_quad(const char *restrict src, const char *restrict end,
+			   unsigned char *restrict dst)
+{
+	unsigned char tmp[4];
+	unsigned int octets = 0, val = 0, saw_digit = 0;
+
+	while (src < end) {
+		const unsigned char c = *src++;
+
+		if ((unsigned int)(c - '0') < 10) {
+			if (saw_digit && val == 0)
+				return 0;
+			val = val * 10 + (c - '0');
+			if (255 < val)
+				return 0;
+			if (!saw_digit) {
+				if (4 < ++octets)
+					return 0;
+				saw_digit = 1;
+			}
+		} else if (c == '.' && saw_digit) {
+			if (octets == 4)
+				return 0;
+			tmp[octets - 1] = val;
+			val = 0;
+			saw_digit = 0;
+		} else
+			return 0;
+	}
+	if (octets < 4 || !saw_digit)
+		return 0;
+	tmp[3] = val;
+	memcpy(dst, tmp, sizeof(tmp));
+	return 1;
+}
+
+/*! \brief Convert IPv6 address to binary form.  The address may use ::
+ * compression, and an embedded IPv4 address in the end.
+ * \param src Beginning of the address.
+ * \param len Length of the address.
+ * \param dst Sixteen bytes of output in network byte order, that is
+ * changed only when the address is valid.
+ * \return True if the address is valid. */
+int parse_ipv6(const char *restrict src, const size_t len, unsigned char *restrict dst)
+{
+	unsigned char tmp[16], *tp = tmp, *const endp = tmp + sizeof(tmp), *colonp = NULL;
+	const char *end = src + len, *curtok;
+	unsigned int val = 0, xdigits = 0;
+	int digit;
+
+	if (src == end)
+		return 0;
+	/* leading :: needs special handling */
+	if (*src == ':' && (++src == end || *src != ':'))
+		return 0;
+	curtok = src;
+	while (src < end) {
+		const char c = *src++;
+
+		if ((digit = hex_digit(c)) >= 0) {
+			if (xdigits == 4)
+				return 0;
+			val = (val << 4) | digit;
+			xdigits++;
+			continue;
+		}
+		if (c == ':') {
+			curtok = src;
+			if (xdigits == 0) {
+				if (colonp != NULL)
+					return 0;
+				colonp = tp;
+				continue;
+			}
+			if (src == end || endp < tp + 2)
+				return 0;
+			*tp++ = val >> 8;
+			*tp++ = val;
+			xdigits = 0;
+			val = 0;
+			continue;
+		}
+		if (c == '.' && tp + 4 <= endp && parse_ipv6_quad(curtok, end, tp)) {
+			tp += 4;
+			xdigits = 0;
+			break;
+		}
+		return 0;
+	}
+	if (xdigits) {
+		if (endp < tp + 2)
+			return 0;
+		*tp++ = val >> 8;
+		*tp++ = val;
+	}
+	if (colonp != NULL) {
+		const size_t n = tp - colonp;
+
+		/* :: must stand for at least one group */
+		if (tp == endp)
+			return 0;
+		memmove(endp - n, colonp, n);
+		memset(colonp, 0, endp - n - colonp);
+		tp = endp;
+	}
+	if (tp != endp)
+		return 0;
+	memcpy(dst, tmp, sizeof(tmp));
+	return 1;
+}
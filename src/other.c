@@ -44,6 +44,7 @@
 #include <limits.h>
 #include <netinet/in.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -52,6 +53,7 @@
 #include "error.h"
 #include "progname.h"
 #include "quote.h"
+#include "xalloc.h"
 
 #include "dhcpd-pools.h"
 #include "defaults.h"
@@ -70,7 +72,6 @@ void set_ipv_functions(int version)
 		find_lease = find_lease_v4;
 		get_range_size = get_range_size_v4;
 		ipcomp = ipcomp_v4;
-		leasecomp = leasecomp_v4;
 		ntop_ipaddr = ntop_ipaddr_v4;
 		parse_ipaddr = parse_ipaddr_v4;
 		xstrstr = xstrstr_v4;
@@ -83,7 +84,6 @@ void set_ipv_functions(int version)
 		find_lease = find_lease_v6;
 		get_range_size = get_range_size_v6;
 		ipcomp = ipcomp_v6;
-		leasecomp = leasecomp_v6;
 		ntop_ipaddr = ntop_ipaddr_v6;
 		parse_ipaddr = parse_ipaddr_v6;
 		xstrstr = xstrstr_v6;
@@ -96,7 +96,6 @@ void set_ipv_functions(int version)
 		find_lease = find_lease_init;
 		get_range_size = get_range_size_init;
 		ipcomp = ipcomp_init;
-		leasecomp = leasecomp_init;
 		ntop_ipaddr = ntop_ipaddr_init;
 		parse_ipaddr = parse_ipaddr_init;
 		xstrstr = xstrstr_init;
@@ -109,43 +108,117 @@ void set_ipv_functions(int version)
 	return;
 }
 
-/*! \brief Convert text string IP address from either IPv4 or IPv6 to an integer.
+/*! \brief Copy an address span to a NUL terminated string for libc.
+ * \param dst Output buffer of MAXLEN bytes.
+ * \param src Beginning of the address.
+ * \param len Length of the address.
+ * \return The dst. */
+static char *ipaddr_string(char *restrict dst, const char *restrict src, size_t len)
+{
+	if (MAXLEN <= len)
+		len = MAXLEN - 1;
+	memcpy(dst, src, len);
+	dst[len] = '\0';
+	return dst;
+}
+
+/*! \brief Parse the common form of IPv4 address, four decimal numbers
+ * separated by dots, in one pass.  Anything else, such as leading zeros
+ * that inet_aton() takes as octal, is left to the caller.
+ * \param src Beginning of the address.
+ * \param len Length of the address.
+ * \param dst The address in host byte order.
+ * \return True if the address was in the common form. */
+static inline int parse_dotted_quad(const char *restrict src, const size_t len,
+				    uint32_t *restrict dst)
+{
+	const char *end = src + len;
+	uint32_t ip = 0;
+	unsigned int part, digits, i;
+
+	for (i = 0; i < 4; i++) {
+		if (src == end || 9 < (unsigned char)(*src - '0'))
+			return 0;
+		if (*src == '0' && src + 1 < end && (unsigned char)(src[1] - '0') <= 9)
+			return 0;
+		part = 0;
+		for (digits = 0; digits < 3 && src < end && (unsigned char)(*src - '0') <= 9; digits++)
+			part = part * 10 + (*src++ - '0');
+		if (255 < part)
+			return 0;
+		ip = (ip << 8) | part;
+		if (i < 3) {
+			if (src == end || *src != '.')
+				return 0;
+			src++;
+		}
+	}
+	if (src != end)
+		return 0;
+	*dst = ip;
+	return 1;
+}
+
+/*! \brief Convert text string IP address from either IPv4 or IPv6 to an
+ * integer, without changing the IP version in use.  Safe to call from
+ * many threads.
  * \param src An IP string in either format.
+ * \param len Length of the string, that does not need to be NUL
+ * terminated.
  * \param dst An union which will hold conversion result.
- * \return Was parsing successful.
+ * \return IP version of the address, IPvUNKNOWN if parsing failed.
  */
-int parse_ipaddr_init(const char *restrict src, union ipaddr_t *restrict dst)
+int parse_ipaddr_any(const char *restrict src, const size_t len, union ipaddr_t *restrict dst)
 {
+	char str[MAXLEN];
 	struct in_addr addr;
-	struct in6_addr addr6;
 
-	if (inet_aton(src, &addr) == 1)
-		set_ipv_functions(IPv4);
-	else if (inet_pton(AF_INET6, src, &addr6) == 1)
-		set_ipv_functions(IPv6);
-	else
+	if (parse_dotted_quad(src, len, &dst->v4))
+		return IPv4;
+	if (inet_aton(ipaddr_string(str, src, len), &addr) == 1) {
+		dst->v4 = ntohl(addr.s_addr);
+		return IPv4;
+	}
+	if (parse_ipv6(src, len, dst->v6))
+		return IPv6;
+	return IPvUNKNOWN;
+}
+
+/*! \brief Convert text string IP address from either IPv4 or IPv6 to an
+ * integer, and set IP version to the one of the address.
+ * \param src An IP string in either format.
+ * \param len Length of the string, that does not need to be NUL
+ * terminated.
+ * \param dst An union which will hold conversion result.
+ * \return Was parsing successful.
+ */
+int parse_ipaddr_init(const char *restrict src, const size_t len, union ipaddr_t *restrict dst)
+{
+	const int version = parse_ipaddr_any(src, len, dst);
+
+	if (version == IPvUNKNOWN)
 		return 0;
-	return parse_ipaddr(src, dst);
+	set_ipv_functions(version);
+	return 1;
 }
 
-int parse_ipaddr_v4(const char *restrict src, union ipaddr_t *restrict dst)
+int parse_ipaddr_v4(const char *restrict src, const size_t len, union ipaddr_t *restrict dst)
 {
 	int rv;
+	char str[MAXLEN];
 	struct in_addr addr;
 
-	rv = inet_aton(src, &addr);
+	if (likely(parse_dotted_quad(src, len, &dst->v4)))
+		return 1;
+	addr.s_addr = 0;
+	rv = inet_aton(ipaddr_string(str, src, len), &addr);
 	dst->v4 = ntohl(addr.s_addr);
 	return rv == 1;
 }
 
-int parse_ipaddr_v6(const char *restrict src, union ipaddr_t *restrict dst)
+int parse_ipaddr_v6(const char *restrict src, const size_t len, union ipaddr_t *restrict dst)
 {
-	int rv;
-	struct in6_addr addr;
-
-	rv = inet_pton(AF_INET6, src, &addr);
-	memcpy(&dst->v6, addr.s6_addr, sizeof(addr.s6_addr));
-	return rv == 1;
+	return parse_ipv6(src, len, dst->v6);
 }
 
 /*! \brief Copy IP address to union.
@@ -216,148 +289,26 @@ double get_range_size_v4(const struct range_t *r)
 	return r->last_ip.v4 - r->first_ip.v4 + 1;
 }
 
+/*! \brief Size of an IPv6 range.  The difference of the addresses is
+ * calculated exactly, and rounded to floating point once.  A range
+ * which last IP is before first IP has negative size. */
 double get_range_size_v6(const struct range_t *r)
 {
-	double size = 0;
-	int i;
-
-	/* When calculating the size of an IPv6 range overflow may occur.
-	 * In that case only the last LONG_BIT bits are preserved, thus
-	 * we just skip the first (16 - LONG_BIT) bits...  */
-	for (i = 0; i < 16; i++) {
-		size *= 256;
-		size += (int)r->last_ip.v6[i] - (int)r->first_ip.v6[i];
-	}
-	return size + 1;
-}
-
-/*! \fn xstrstr_init(const char *restrict str)
- * \brief Determine if the dhcpd is in IPv4 or IPv6 mode. This function
- * may be needed when dhcpd.conf file has zero IP version hints.
- *
- * \param str A line from dhcpd.conf
- * \return prefix_t enum value
- */
-int
-#if __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 3)
-    __attribute__ ((hot))
+#ifdef HAVE_UNSIGNED___INT128
+	const unsigned __int128 first = ipv6_int(&r->first_ip), last = ipv6_int(&r->last_ip);
+
+	if (last < first)
+		return 1 - (double)(first - last);
+	return (double)(last - first) + 1;
+#else
+	const double half = 18446744073709551616.0;	/* 2^64 */
+	const uint64_t fh = ipv6_half(r->first_ip.v6), fl = ipv6_half(r->first_ip.v6 + 8);
+	const uint64_t lh = ipv6_half(r->last_ip.v6), ll = ipv6_half(r->last_ip.v6 + 8);
+
+	if (lh < fh || (lh == fh && ll < fl))
+		return 1 - ((double)(fh - lh - (fl < ll)) * half + (double)(fl - ll));
+	return (double)(lh - fh - (ll < fl)) * half + (double)(ll - fl) + 1;
 #endif
-    xstrstr_init(const char *restrict str)
-{
-	if (memcmp("lease ", str, 6)) {
-		set_ipv_functions(IPv4);
-		return PREFIX_LEASE;
-	} else if (memcmp("  iaaddr ", str, 9)) {
-		set_ipv_functions(IPv6);
-		return PREFIX_LEASE;
-	}
-	return NUM_OF_PREFIX;
-}
-
-/*! \fn xstrstr_v4(const char *restrict str)
- * \brief parse lease file in IPv4 mode
- *
- * \param str A line from dhcpd.conf
- * \return prefix_t enum value
- */
-int
-#if __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 3)
-    __attribute__ ((hot))
-#endif
-    xstrstr_v4(const char *restrict str)
-{
-	size_t len;
-
-	if (str[2] == 'b' || str[2] == 'h')
-		len = strlen(str);
-	else
-		len = 0;
-	if (15 < len) {
-		switch (str[16]) {
-		case 'f':
-			if (!memcmp("  binding state free;", str, 21))
-				return PREFIX_BINDING_STATE_FREE;
-			break;
-		case 'a':
-			if (!memcmp("  binding state active;", str, 23))
-				return PREFIX_BINDING_STATE_ACTIVE;
-			if (!memcmp("  binding state abandoned;", str, 25))
-				return PREFIX_BINDING_STATE_ABANDONED;
-			break;
-		case 'e':
-			if (!memcmp("  binding state expired;", str, 24))
-				return PREFIX_BINDING_STATE_EXPIRED;
-			break;
-		case 'r':
-			if (!memcmp("  binding state released;", str, 25))
-				return PREFIX_BINDING_STATE_RELEASED;
-			break;
-		case 'b':
-			if (!memcmp("  binding state backup;", str, 23))
-				return PREFIX_BINDING_STATE_BACKUP;
-			break;
-		case 'n':
-			if (!memcmp("  hardware ethernet", str, 19))
-				return PREFIX_HARDWARE_ETHERNET;
-			break;
-		}
-	}
-	if (!memcmp("lease ", str, 6))
-		return PREFIX_LEASE;
-	return NUM_OF_PREFIX;
-}
-
-/*! \fn xstrstr_v4(const char *restrict str)
- * \brief parse lease file in IPv6 mode
- *
- * \param str A line from dhcpd.conf
- * \return prefix_t enum value
- */
-int
-#if __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 3)
-    __attribute__ ((hot))
-#endif
-    xstrstr_v6(const char *restrict str)
-{
-	size_t len;
-
-	if (str[4] == 'b' || str[2] == 'h')
-		len = strlen(str);
-	else
-		len = 0;
-	if (17 < len) {
-		switch (str[18]) {
-		case 'f':
-			if (!memcmp("    binding state free;", str, 23))
-				return PREFIX_BINDING_STATE_FREE;
-			break;
-		case 'a':
-			if (!memcmp("    binding state active;", str, 25))
-				return PREFIX_BINDING_STATE_ACTIVE;
-			if (!memcmp("    binding state abandoned;", str, 27))
-				return PREFIX_BINDING_STATE_ABANDONED;
-			break;
-		case 'e':
-			if (!memcmp("    binding state expired;", str, 26))
-				return PREFIX_BINDING_STATE_EXPIRED;
-			break;
-		case 'r':
-			if (!memcmp("    binding state released;", str, 27))
-				return PREFIX_BINDING_STATE_RELEASED;
-			break;
-		case 'b':
-			if (!memcmp("    binding state backup;", str, 25))
-				return PREFIX_BINDING_STATE_BACKUP;
-			break;
-		case 'n':
-			if (!memcmp("  hardware ethernet", str, 19))
-				return PREFIX_HARDWARE_ETHERNET;
-			break;
-		}
-	}
-	if (!memcmp("  iaaddr ", str, 9))
-		return PREFIX_LEASE;
-	return NUM_OF_PREFIX;
 }
 
 /*! \brief Return a double floating point value.
@@ -399,31 +350,61 @@ void flip_ranges(struct range_t *restrict flip_me, struct range_t *restrict tmp_
 	memcpy(flip_me, tmp_ranges, num_ranges * sizeof(struct range_t));
 }
 
-/*! \brief Free memory, flush buffers etc. */
-void clean_up(void)
+/*! \struct arena_block
+ * \brief A block of the allocation arena.  The allocations follow the
+ * header. */
+struct arena_block {
+	struct arena_block *next;
+	size_t used;
+	size_t size;
+};
+
+/*! \var arena
+ * \brief The block allocations are currently cut from. */
+static struct arena_block *arena;
+
+/*! \brief Allocate memory that lives until the program exits.  The
+ * memory is cut from large blocks, so the allocations cost neither a
+ * malloc() call nor a free() call each.  Not thread safe.
+ * \param size Number of bytes.
+ * \return Zero filled memory. */
+void *arena_alloc(size_t size)
+{
+	const size_t header = (sizeof(struct arena_block) + 15) & ~(size_t)15;
+	struct arena_block *block;
+	void *p;
+
+	size = (size + 15) & ~(size_t)15;
+	if (arena == NULL || arena->size - arena->used < size) {
+		const size_t block_size = size < ARENA_BLOCK_SIZE ? ARENA_BLOCK_SIZE : size;
+
+		block = xcalloc(1, header + block_size);
+		block->size = block_size;
+		block->next = arena;
+		arena = block;
+	}
+	p = (char *)arena + header + arena->used;
+	arena->used += size;
+	return p;
+}
+
+/*! \brief Copy a string to the allocation arena.
+ * \param str The string.
+ * \return The copy. */
+char *arena_strdup(const char *str)
 {
-	struct output_sort *cur, *next;
+	const size_t len = strlen(str) + 1;
+
+	return memcpy(arena_alloc(len), str, len);
+}
 
+/*! \brief Flush buffers before exit.  Nothing is freed, the whole
+ * address space is returned at once when the process exits. */
+void clean_up(void)
+{
 	/* Just in case there something in buffers */
 	if (fflush(NULL))
 		error(EXIT_FAILURE, errno, "clean_up: fflush");
-	free(config.dhcpdconf_file);
-	free(config.dhcpdlease_file);
-	free(config.output_file);
-	free(ranges);
-	delete_all_leases();
-	if (shared_networks) {
-		unsigned int i;
-
-		num_shared_networks++;
-		for (i = 0; i < num_shared_networks; i++)
-			free((shared_networks + i)->name);
-		free(shared_networks);
-	}
-	for (cur = config.sorts; cur; cur = next) {
-		next = cur->next;
-		free(cur);
-	}
 }
 
 /*! \brief A version printing. */
@@ -447,7 +428,7 @@ void __attribute__ ((__noreturn__)) usage(int status)
 	fputs(		"This is ISC dhcpd pools usage analyzer.\n", out);
 	fputs(		"\n", out);
 	fputs(		"  -c, --config=FILE      path to the dhcpd.conf file\n", out);
-	fputs(		"  -l, --leases=FILE      path to the dhcpd.leases file\n", out);
+	fputs(		"  -l, --leases=FILE      path to the dhcpd.leases file, - for stdin\n", out);
 	fputs(		"  -f, --format=[thHcxXjJ] output format\n", out);
 	fputs(		"                           t for text\n", out);
 	fputs(		"                           H for full html page\n", out);
@@ -476,6 +457,12 @@ void __attribute__ ((__noreturn__)) usage(int status)
 	fputs(		"      --snet-alarms      suppress range alarms that are part of a shared-net\n", out);
 	fputs(		"  -p, --perfdata         print additional perfdata in alarming mode\n", out);
 	fputs(		"  -A, --all-as-shared    treat single subnets as shared-network with CIDR as their name\n", out);
+	fputs(		"      --jobs=NR          parse files and count ranges using NR threads\n", out);
+	fputs(		"      --scan-backwards   read lease file from end to beginning\n", out);
+	fputs(		"      --state-file=FILE  save leases, and parse only new ones next time\n", out);
+	fputs(		"      --config-cache=FILE\n", out);
+	fputs(		"                         save configuration, and parse only changed files\n", out);
+	fputs(		"      --outside          count leases that are not in any range\n", out);
 	fputs(		"  -v, --version          output version information and exit\n", out);
 	fputs(		"  -h, --help             display this help and exit\n", out);
 	fputs(		"\n", out);
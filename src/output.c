@@ -114,14 +114,14 @@ int output_txt(void)
 				max_ipaddr_length,
 				ntop_ipaddr(&range_p->last_ip),
 				range_size,
-				range_p->count,
+				(double)range_p->count,
 				(float)(100 * range_p->count) / range_size,
-				range_p->touched,
-				range_p->touched + range_p->count,
+				(double)range_p->touched,
+				(double)(range_p->touched + range_p->count),
 				(float)(100 * (range_p->touched + range_p->count)) / range_size);
 			if (config.backups_found == 1) {
 				fprintf(outfile, "%7g %8.3f",
-					range_p->backups,
+					(double)range_p->backups,
 					(float)(100 * range_p->backups) / range_size);
 			}
 			fprintf(outfile, "\n");
@@ -147,16 +147,17 @@ int output_txt(void)
 			fprintf(outfile,
 				"%-20s %5g %5g %10.3f %7g %6g %9.3f",
 				shared_p->name, shared_p->available,
-				shared_p->used,
+				(double)shared_p->used,
 				shared_p->available ==
 				0 ? NAN : (float)(100 * shared_p->used) / shared_p->available,
-				shared_p->touched, shared_p->touched + shared_p->used,
+				(double)shared_p->touched,
+				(double)(shared_p->touched + shared_p->used),
 				shared_p->available ==
 				0 ? NAN : ((float)(100 * (shared_p->touched + shared_p->used)) /
 					    shared_p->available));
 			if (config.backups_found == 1) {
 				fprintf(outfile, "%7g %8.3f",
-					shared_p->backups,
+					(double)shared_p->backups,
 					(float)(100 * shared_p->backups) / shared_p->available);
 			}
 
@@ -180,11 +181,11 @@ int output_txt(void)
 		fprintf(outfile, "%-20s %5g %5g %10.3f %7g %6g %9.3f",
 			shared_networks->name,
 			shared_networks->available,
-			shared_networks->used,
+			(double)shared_networks->used,
 			shared_networks->available ==
 			0 ? NAN : (float)(100 * shared_networks->used) /
-			shared_networks->available, shared_networks->touched,
-			shared_networks->touched + shared_networks->used,
+			shared_networks->available, (double)shared_networks->touched,
+			(double)(shared_networks->touched + shared_networks->used),
 			shared_networks->available ==
 			0 ? NAN : (float)(100 *
 					   (shared_networks->touched +
@@ -198,6 +199,15 @@ int output_txt(void)
 		}
 		fprintf(outfile, "\n");
 	}
+	if (config.print_outside) {
+		if (config.header_limit & A_BIT || config.number_limit & A_BIT) {
+			fprintf(outfile, "\n");
+		}
+		fprintf(outfile, "Outside of ranges:\n");
+		fprintf(outfile, "  cur  touch     bu\n");
+		fprintf(outfile, "%5g %6g %6g\n", (double)outside_ranges.used,
+			(double)outside_ranges.touched, (double)outside_ranges.backups);
+	}
 	if (outfile == stdout) {
 		ret = fflush(stdout);
 		if (ret) {
@@ -240,15 +250,14 @@ int output_xml(void)
 
 	if (config.print_mac_addreses == 1) {
 		struct leases_t *l;
+		char mac[MAC_STRING_LEN + 1];
 
-		for (l = leases; l != NULL; l = l->hh.next) {
+		for (l = leases.slots; l < leases.slots + leases.count; l++) {
 			if (l->type == ACTIVE) {
 				fputs("<active_lease>\n\t<ip>", outfile);
 				fputs(ntop_ipaddr(&l->ip), outfile);
 				fputs("</ip>\n\t<macaddress>", outfile);
-				if (l->ethernet != NULL) {
-					fputs(l->ethernet, outfile);
-				}
+				fputs(lease_ethernet(&leases, l, mac), outfile);
 				fputs("</macaddress>\n</active_lease>\n", outfile);
 			}
 		}
@@ -266,8 +275,8 @@ int output_xml(void)
 			fprintf(outfile, "\t<range>%s ", ntop_ipaddr(&range_p->first_ip));
 			fprintf(outfile, "- %s</range>\n", ntop_ipaddr(&range_p->last_ip));
 			fprintf(outfile, "\t<defined>%g</defined>\n", range_size);
-			fprintf(outfile, "\t<used>%g</used>\n", range_p->count);
-			fprintf(outfile, "\t<touched>%g</touched>\n", range_p->touched);
+			fprintf(outfile, "\t<used>%g</used>\n", (double)range_p->count);
+			fprintf(outfile, "\t<touched>%g</touched>\n", (double)range_p->touched);
 			fprintf(outfile, "\t<free>%g</free>\n", range_size - range_p->count);
 			range_p++;
 			range_size = get_range_size(range_p);
@@ -281,8 +290,8 @@ int output_xml(void)
 			fprintf(outfile, "<shared-network>\n");
 			fprintf(outfile, "\t<location>%s</location>\n", shared_p->name);
 			fprintf(outfile, "\t<defined>%g</defined>\n", shared_p->available);
-			fprintf(outfile, "\t<used>%g</used>\n", shared_p->used);
-			fprintf(outfile, "\t<touched>%g</touched>\n", shared_p->touched);
+			fprintf(outfile, "\t<used>%g</used>\n", (double)shared_p->used);
+			fprintf(outfile, "\t<touched>%g</touched>\n", (double)shared_p->touched);
 			fprintf(outfile, "\t<free>%g</free>\n",
 				shared_p->available - shared_p->used);
 			fprintf(outfile, "</shared-network>\n");
@@ -293,13 +302,21 @@ int output_xml(void)
 		fprintf(outfile, "<summary>\n");
 		fprintf(outfile, "\t<location>%s</location>\n", shared_networks->name);
 		fprintf(outfile, "\t<defined>%g</defined>\n", shared_networks->available);
-		fprintf(outfile, "\t<used>%g</used>\n", shared_networks->used);
-		fprintf(outfile, "\t<touched>%g</touched>\n", shared_networks->touched);
+		fprintf(outfile, "\t<used>%g</used>\n", (double)shared_networks->used);
+		fprintf(outfile, "\t<touched>%g</touched>\n", (double)shared_networks->touched);
 		fprintf(outfile, "\t<free>%g</free>\n",
 			shared_networks->available - shared_networks->used);
 		fprintf(outfile, "</summary>\n");
 	}
 
+	if (config.print_outside) {
+		fprintf(outfile, "<outside>\n");
+		fprintf(outfile, "\t<used>%g</used>\n", (double)outside_ranges.used);
+		fprintf(outfile, "\t<touched>%g</touched>\n", (double)outside_ranges.touched);
+		fprintf(outfile, "\t<backups>%g</backups>\n", (double)outside_ranges.backups);
+		fprintf(outfile, "</outside>\n");
+	}
+
 	fprintf(outfile, "</dhcpstatus>\n");
 	if (outfile == stdout) {
 		ret = fflush(stdout);
@@ -345,9 +362,10 @@ int output_json(void)
 
 	if (config.print_mac_addreses == 1) {
 		struct leases_t *l;
+		char mac[MAC_STRING_LEN + 1];
 
 		fprintf(outfile, "   \"active_leases\": [");
-		for (l = leases; l != NULL; l = l->hh.next) {
+		for (l = leases.slots; l < leases.slots + leases.count; l++) {
 			if (l->type == ACTIVE) {
 				if (i == 0) {
 					i = 1;
@@ -357,9 +375,7 @@ int output_json(void)
 				fputs("\n         { \"ip\":\"", outfile);
 				fputs(ntop_ipaddr(&l->ip), outfile);
 				fputs("\", \"macaddress\":\"", outfile);
-				if (l->ethernet != NULL) {
-					fputs(l->ethernet, outfile);
-				}
+				fputs(lease_ethernet(&leases, l, mac), outfile);
 				fputs("\" }", outfile);
 			}
 		}
@@ -385,8 +401,8 @@ int output_json(void)
 			fprintf(outfile, "\"range\":\"%s", ntop_ipaddr(&range_p->first_ip));
 			fprintf(outfile, " - %s\", ", ntop_ipaddr(&range_p->last_ip));
 			fprintf(outfile, "\"defined\":%g, ", range_size);
-			fprintf(outfile, "\"used\":%g, ", range_p->count);
-			fprintf(outfile, "\"touched\":%g, ", range_p->touched);
+			fprintf(outfile, "\"used\":%g, ", (double)range_p->count);
+			fprintf(outfile, "\"touched\":%g, ", (double)range_p->touched);
 			fprintf(outfile, "\"free\":%g ", range_size - range_p->count);
 			range_p++;
 			range_size = get_range_size(range_p);
@@ -410,8 +426,8 @@ int output_json(void)
 			fprintf(outfile, "{ ");
 			fprintf(outfile, "\"location\":\"%s\", ", shared_p->name);
 			fprintf(outfile, "\"defined\":%g, ", shared_p->available);
-			fprintf(outfile, "\"used\":%g, ", shared_p->used);
-			fprintf(outfile, "\"touched\":%g, ", shared_p->touched);
+			fprintf(outfile, "\"used\":%g, ", (double)shared_p->used);
+			fprintf(outfile, "\"touched\":%g, ", (double)shared_p->touched);
 			fprintf(outfile, "\"free\":%g ", shared_p->available - shared_p->used);
 			if (i + 1 < num_shared_networks)
 				fprintf(outfile, "},\n");
@@ -429,11 +445,23 @@ int output_json(void)
 		fprintf(outfile, "   \"summary\": {\n");
 		fprintf(outfile, "         \"location\":\"%s\",\n", shared_networks->name);
 		fprintf(outfile, "         \"defined\":%g,\n", shared_networks->available);
-		fprintf(outfile, "         \"used\":%g,\n", shared_networks->used);
-		fprintf(outfile, "         \"touched\":%g,\n", shared_networks->touched);
+		fprintf(outfile, "         \"used\":%g,\n", (double)shared_networks->used);
+		fprintf(outfile, "         \"touched\":%g,\n", (double)shared_networks->touched);
 		fprintf(outfile, "         \"free\":%g\n",
 			shared_networks->available - shared_networks->used);
 		fprintf(outfile, "   }");	/* end of summary */
+		sep++;
+	}
+
+	if (config.print_outside) {
+		if (sep) {
+			fprintf(outfile, ",\n");
+		}
+		fprintf(outfile, "   \"outside\": {\n");
+		fprintf(outfile, "         \"used\":%g,\n", (double)outside_ranges.used);
+		fprintf(outfile, "         \"touched\":%g,\n", (double)outside_ranges.touched);
+		fprintf(outfile, "         \"backups\":%g\n", (double)outside_ranges.backups);
+		fprintf(outfile, "   }");	/* end of outside */
 	}
 
 	fprintf(outfile, "\n}\n");
@@ -767,6 +795,25 @@ int output_html(void)
 		end_tag(outfile, "tbody");
 	}
 	table_end(outfile);
+	if (config.print_outside) {
+		newsection(outfile, "Outside of ranges");
+		table_start(outfile, "o", "outside");
+		start_tag(outfile, "thead");
+		start_tag(outfile, "tr");
+		output_line(outfile, "th", "cur");
+		output_line(outfile, "th", "touch");
+		output_line(outfile, "th", "bu");
+		end_tag(outfile, "tr");
+		end_tag(outfile, "thead");
+		start_tag(outfile, "tbody");
+		start_tag(outfile, "tr");
+		output_double(outfile, "td", outside_ranges.used);
+		output_double(outfile, "td", outside_ranges.touched);
+		output_double(outfile, "td", outside_ranges.backups);
+		end_tag(outfile, "tr");
+		end_tag(outfile, "tbody");
+		table_end(outfile);
+	}
 	html_footer(outfile);
 	if (outfile == stdout) {
 		ret = fflush(stdout);
@@ -825,14 +872,14 @@ int output_csv(void)
 			fprintf(outfile,
 				"\"%s\",\"%g\",\"%g\",\"%.3f\",\"%g\",\"%g\",\"%.3f\"",
 				ntop_ipaddr(&range_p->last_ip), range_size,
-				range_p->count,
+				(double)range_p->count,
 				(float)(100 * range_p->count) / range_size,
-				range_p->touched,
-				range_p->touched + range_p->count,
+				(double)range_p->touched,
+				(double)(range_p->touched + range_p->count),
 				(float)(100 * (range_p->touched + range_p->count)) / range_size);
 			if (config.backups_found == 1) {
 				fprintf(outfile, ",\"%g\",\"%.3f\"",
-					range_p->backups,
+					(double)range_p->backups,
 					(float)(100 * range_p->backups) / range_size);
 			}
 
@@ -858,17 +905,17 @@ int output_csv(void)
 			fprintf(outfile,
 				"\"%s\",\"%g\",\"%g\",\"%.3f\",\"%g\",\"%g\",\"%.3f\"",
 				shared_p->name, shared_p->available,
-				shared_p->used,
+				(double)shared_p->used,
 				shared_p->available == 0 ? NAN : (float)(100 * shared_p->used) /
-				shared_p->available, shared_p->touched,
-				shared_p->touched + shared_p->used,
+				shared_p->available, (double)shared_p->touched,
+				(double)(shared_p->touched + shared_p->used),
 				shared_p->available == 0 ? NAN : (float)(100 *
 									  (shared_p->touched +
 									   shared_p->used)) /
 				shared_p->available);
 			if (config.backups_found == 1) {
 				fprintf(outfile, ",\"%g\",\"%.3f\"",
-					shared_p->backups,
+					(double)shared_p->backups,
 					shared_p->available ==
 					0 ? NAN : (float)(100 * shared_p->backups) /
 					shared_p->available);
@@ -892,24 +939,33 @@ int output_csv(void)
 		fprintf(outfile,
 			"\"%s\",\"%g\",\"%g\",\"%.3f\",\"%g\",\"%g\",\"%.3f\"",
 			shared_networks->name, shared_networks->available,
-			shared_networks->used,
+			(double)shared_networks->used,
 			shared_networks->available ==
 			0 ? NAN : (float)(100 * shared_networks->used) /
-			shared_networks->available, shared_networks->touched,
-			shared_networks->touched + shared_networks->used,
+			shared_networks->available, (double)shared_networks->touched,
+			(double)(shared_networks->touched + shared_networks->used),
 			shared_networks->available ==
 			0 ? NAN : (float)(100 *
 					   (shared_networks->touched +
 					    shared_networks->used)) / shared_networks->available);
 		if (config.backups_found == 1) {
 			fprintf(outfile, "%7g %8.3f",
-				shared_networks->backups,
+				(double)shared_networks->backups,
 				shared_networks->available ==
 				0 ? NAN : (float)(100 * shared_networks->backups) /
 				shared_networks->available);
 		}
 		fprintf(outfile, "\n");
 	}
+	if (config.print_outside) {
+		if (config.number_limit & A_BIT) {
+			fprintf(outfile, "\n");
+		}
+		fprintf(outfile, "\"Outside of ranges:\"\n");
+		fprintf(outfile, "\"cur\",\"touch\",\"bu\"\n");
+		fprintf(outfile, "\"%g\",\"%g\",\"%g\"\n", (double)outside_ranges.used,
+			(double)outside_ranges.touched, (double)outside_ranges.backups);
+	}
 	if (outfile == stdout) {
 		ret = fflush(stdout);
 		if (ret) {
@@ -1028,17 +1084,17 @@ int output_alarming(void)
 					fprintf(outfile, " %s_r=",
 						ntop_ipaddr(&range_p->first_ip));
 					fprintf(outfile, "%g;%g;%g;0;%g",
-						range_p->count,
+						(double)range_p->count,
 						(range_size * config.warning / 100),
 						(range_size * config.critical / 100),
 						range_size);
 					fprintf(outfile, " %s_rt=%g",
 						ntop_ipaddr(&range_p->first_ip),
-						range_p->touched);
+						(double)range_p->touched);
 					if (config.backups_found == 1) {
 						fprintf(outfile, " %s_rbu=%g",
 							ntop_ipaddr(&range_p->first_ip),
-							range_p->backups);
+							(double)range_p->backups);
 					}
 				}
 			}
@@ -1061,17 +1117,17 @@ int output_alarming(void)
 				if (config.minsize < shared_p->available) {
 					fprintf(outfile, " '%s_s'=%g;%g;%g;0;%g",
 						shared_p->name,
-						shared_p->used,
+						(double)shared_p->used,
 						(shared_p->available * config.warning / 100),
 						(shared_p->available * config.critical / 100),
 						shared_p->available);
 					fprintf(outfile, " '%s_st'=%g",
 						shared_p->name,
-						shared_p->touched);
+						(double)shared_p->touched);
 					if (config.backups_found == 1) {
 						fprintf(outfile, " '%s_sbu'=%g",
 						shared_p->name,
-						shared_p->backups);
+						(double)shared_p->backups);
 					}
 				}
 				shared_p--;
@@ -0,0 +1,407 @@
+/*
+ * The dhcpd-pools has BSD 2-clause license which also known as "Simplified
+ * BSD License" or "FreeBSD License".
+ *
+ * Copyright 2006- Sami Kerola. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the
+ *       distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR AND CONTRIBUTORS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing
+ * official policies, either expressed or implied, of Sami Kerola.
+ */
+
+/*! \file scan.c
+ * \brief Lease file lexer.  Vectorized search of lease file lines that
+ * may be interesting, and table driven recognition of the lease file
+ * statements.  The search looks at 16 or 32 bytes at a time, and lines
+ * that cannot match are skipped without examining them byte by byte.
+ */
+
+#include <config.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xalloc.h"
+
+#include "dhcpd-pools.h"
+
+#if defined(HAVE_IMMINTRIN_H) && defined(HAVE_BUILTIN_CPU_SUPPORTS) && \
+    (defined(__x86_64__) || defined(__i386__))
+# define SCAN_X86 1
+# include <immintrin.h>
+#endif
+
+/*! \def SCAN_LOOKAHEAD
+ * \brief Number of bytes after a new line character the candidate test
+ * needs to see.  */
+#define SCAN_LOOKAHEAD 5
+
+/*! \brief Scalar version of the candidate line test.  Interesting lines
+ * in either IPv4 or IPv6 lease file begin with "lease ", "  binding",
+ * "    binding", "  hardware", or "  iaaddr".  All other lines can be
+ * skipped.
+ * \param s Pointer to beginning of a line.
+ * \param end End of the buffer.
+ * \return True if the line may be interesting. */
+static inline int is_candidate(const char *restrict s, const char *restrict end)
+{
+	if (end - s < 3)
+		return s < end && s[0] == 'l';
+	if (s[0] == 'l')
+		return 1;
+	if (s[0] != ' ' || s[1] != ' ')
+		return 0;
+	if (s[2] == 'b' || s[2] == 'h' || s[2] == 'i')
+		return 1;
+	return 4 < end - s && s[2] == ' ' && s[3] == ' ' && s[4] == 'b';
+}
+
+/*! \brief Scalar line finder that uses memchr() to move from a line to
+ * another.
+ * \param p Search start position.
+ * \param end End of the buffer.
+ * \return Beginning of the next candidate line, or NULL. */
+static const char *next_lease_line_scalar(const char *restrict p, const char *restrict end)
+{
+	const char *nl;
+
+	while (p < end && (nl = memchr(p, '\n', end - p)) != NULL) {
+		p = nl + 1;
+		if (is_candidate(p, end))
+			return p;
+	}
+	return NULL;
+}
+
+#ifdef SCAN_X86
+/*! \brief SSE2 line finder.  Bit mask of candidate lines is formed for
+ * 16 bytes at the time by comparing a new line character, and characters
+ * following it, to the interesting line prefixes.
+ * \param p Search start position.
+ * \param end End of the buffer.
+ * \return Beginning of the next candidate line, or NULL. */
+__attribute__ ((__target__("sse2")))
+static const char *next_lease_line_sse2(const char *restrict p, const char *restrict end)
+{
+	const __m128i nl = _mm_set1_epi8('\n');
+	const __m128i sp = _mm_set1_epi8(' ');
+	const __m128i l = _mm_set1_epi8('l');
+	const __m128i b = _mm_set1_epi8('b');
+	const __m128i h = _mm_set1_epi8('h');
+	const __m128i i = _mm_set1_epi8('i');
+
+	while (p + 16 + SCAN_LOOKAHEAD <= end) {
+		__m128i c0, c1, c2, c3, c4, c5, m;
+		unsigned int mask;
+
+		c0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), nl);
+		if (_mm_movemask_epi8(c0) == 0) {
+			p += 16;
+			continue;
+		}
+		c1 = _mm_loadu_si128((const __m128i *)(p + 1));
+		c2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 2)), sp);
+		c3 = _mm_loadu_si128((const __m128i *)(p + 3));
+		c4 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 4)), sp);
+		c5 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 5)), b);
+		/* "    b" */
+		m = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(c3, sp), c4), c5);
+		/* "  b", "  h", "  i" */
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(c3, b));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(c3, h));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(c3, i));
+		m = _mm_and_si128(m, _mm_and_si128(_mm_cmpeq_epi8(c1, sp), c2));
+		/* "l" */
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(c1, l));
+		mask = _mm_movemask_epi8(_mm_and_si128(m, c0));
+		if (mask)
+			return p + __builtin_ctz(mask) + 1;
+		p += 16;
+	}
+	return next_lease_line_scalar(p, end);
+}
+
+/*! \brief AVX2 line finder, see next_lease_line_sse2().
+ * \param p Search start position.
+ * \param end End of the buffer.
+ * \return Beginning of the next candidate line, or NULL. */
+__attribute__ ((__target__("avx2")))
+static const char *next_lease_line_avx2(const char *restrict p, const char *restrict end)
+{
+	const __m256i nl = _mm256_set1_epi8('\n');
+	const __m256i sp = _mm256_set1_epi8(' ');
+	const __m256i l = _mm256_set1_epi8('l');
+	const __m256i b = _mm256_set1_epi8('b');
+	const __m256i h = _mm256_set1_epi8('h');
+	const __m256i i = _mm256_set1_epi8('i');
+
+	while (p + 32 + SCAN_LOOKAHEAD <= end) {
+		__m256i c0, c1, c2, c3, c4, c5, m;
+		unsigned int mask;
+
+		c0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), nl);
+		if (_mm256_movemask_epi8(c0) == 0) {
+			p += 32;
+			continue;
+		}
+		c1 = _mm256_loadu_si256((const __m256i *)(p + 1));
+		c2 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 2)), sp);
+		c3 = _mm256_loadu_si256((const __m256i *)(p + 3));
+		c4 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 4)), sp);
+		c5 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 5)), b);
+		m = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(c3, sp), c4), c5);
+		m = _mm256_or_si256(m, _mm256_cmpeq_epi8(c3, b));
+		m = _mm256_or_si256(m, _mm256_cmpeq_epi8(c3, h));
+		m = _mm256_or_si256(m, _mm256_cmpeq_epi8(c3, i));
+		m = _mm256_and_si256(m, _mm256_and_si256(_mm256_cmpeq_epi8(c1, sp), c2));
+		m = _mm256_or_si256(m, _mm256_cmpeq_epi8(c1, l));
+		mask = _mm256_movemask_epi8(_mm256_and_si256(m, c0));
+		if (mask)
+			return p + __builtin_ctz(mask) + 1;
+		p += 32;
+	}
+	return next_lease_line_sse2(p, end);
+}
+#endif				/* SCAN_X86 */
+
+static const char *next_lease_line_init(const char *restrict p, const char *restrict end);
+
+/*! \var next_lease_line_impl
+ * \brief The line finder selected at run time.  */
+static const char *(*next_lease_line_impl) (const char *restrict p,
+					    const char *restrict end) = next_lease_line_init;
+
+/*! \brief Select the fastest line finder the processor supports, and
+ * use it for this and all following calls.
+ * \param p Search start position.
+ * \param end End of the buffer.
+ * \return Beginning of the next candidate line, or NULL. */
+static const char *next_lease_line_init(const char *restrict p, const char *restrict end)
+{
+	next_lease_line_impl = next_lease_line_scalar;
+#ifdef SCAN_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		next_lease_line_impl = next_lease_line_avx2;
+	else if (__builtin_cpu_supports("sse2"))
+		next_lease_line_impl = next_lease_line_sse2;
+#endif
+	return next_lease_line_impl(p, end);
+}
+
+/*! \brief Find the next line that may be interesting to xstrstr().
+ * \param p Search start position, typically the new line character
+ * that ended the previous line.
+ * \param end End of the buffer.
+ * \return Beginning of the next candidate line, or NULL when there are
+ * no more candidates before end. */
+const char *next_lease_line(const char *restrict p, const char *restrict end)
+{
+	return next_lease_line_impl(p, end);
+}
+
+/*! \struct lease_keyword
+ * \brief Lease file statement, as it is written by dhcpd, including the
+ * indentation that tells which block the statement belongs to.
+ */
+struct lease_keyword {
+	const char *prefix;
+	enum prefix_t type;
+};
+
+/*! \var lease_keywords_v4
+ * \brief IPv4 lease file grammar.  */
+static const struct lease_keyword lease_keywords_v4[] = {
+	{"lease ", PREFIX_LEASE},
+	{"  binding state free;", PREFIX_BINDING_STATE_FREE},
+	{"  binding state abandoned;", PREFIX_BINDING_STATE_ABANDONED},
+	{"  binding state expired;", PREFIX_BINDING_STATE_EXPIRED},
+	{"  binding state released;", PREFIX_BINDING_STATE_RELEASED},
+	{"  binding state active;", PREFIX_BINDING_STATE_ACTIVE},
+	{"  binding state backup;", PREFIX_BINDING_STATE_BACKUP},
+	{"  hardware ethernet ", PREFIX_HARDWARE_ETHERNET},
+	{NULL, NUM_OF_PREFIX}
+};
+
+/*! \var lease_keywords_v6
+ * \brief IPv6 lease file grammar.  */
+static const struct lease_keyword lease_keywords_v6[] = {
+	{"  iaaddr ", PREFIX_LEASE},
+	{"    binding state free;", PREFIX_BINDING_STATE_FREE},
+	{"    binding state abandoned;", PREFIX_BINDING_STATE_ABANDONED},
+	{"    binding state expired;", PREFIX_BINDING_STATE_EXPIRED},
+	{"    binding state released;", PREFIX_BINDING_STATE_RELEASED},
+	{"    binding state active;", PREFIX_BINDING_STATE_ACTIVE},
+	{"    binding state backup;", PREFIX_BINDING_STATE_BACKUP},
+	{NULL, NUM_OF_PREFIX}
+};
+
+/*! \def LEASE_DFA_STATES
+ * \brief Upper limit of states in lease_dfa.  */
+#define LEASE_DFA_STATES 512
+
+/*! \def LEASE_DFA_DEAD
+ * \brief The state where no keyword can match anymore.  */
+#define LEASE_DFA_DEAD 0
+
+/*! \def LEASE_DFA_START
+ * \brief Initial state of lease_dfa.  */
+#define LEASE_DFA_START 1
+
+/*! \struct lease_dfa
+ * \brief Deterministic finite automaton recognizing lease file
+ * statements.  Input bytes are mapped to character classes, so that the
+ * transition table stays small enough to be cache friendly.
+ */
+struct lease_dfa {
+	uint16_t nclasses;
+	uint16_t nstates;
+	uint8_t class[256];
+	uint8_t accept[LEASE_DFA_STATES];
+	uint16_t *next;
+};
+
+/*! \var lease_dfa
+ * \brief Automatons for IPv4 and IPv6 lease files.  */
+static struct lease_dfa lease_dfa[2];
+
+/*! \brief Generate lease file statement recognizer.
+ * \param dfa The automaton to be generated.
+ * \param kw Grammar of the lease file.
+ * \param length Output of keyword lengths, indexed by prefix_t. */
+static void build_lease_dfa(struct lease_dfa *dfa, const struct lease_keyword *kw,
+			    int *length)
+{
+	const struct lease_keyword *k;
+	const char *c;
+
+	free(dfa->next);
+	memset(dfa->class, 0, sizeof(dfa->class));
+	dfa->nclasses = 1;
+	for (k = kw; k->prefix; k++) {
+		for (c = k->prefix; *c; c++)
+			if (dfa->class[(unsigned char)*c] == 0)
+				dfa->class[(unsigned char)*c] = dfa->nclasses++;
+	}
+	dfa->next = xcalloc(LEASE_DFA_STATES * dfa->nclasses, sizeof(uint16_t));
+	memset(dfa->accept, NUM_OF_PREFIX, sizeof(dfa->accept));
+	dfa->nstates = LEASE_DFA_START + 1;
+	for (k = kw; k->prefix; k++) {
+		unsigned int state = LEASE_DFA_START;
+
+		for (c = k->prefix; *c; c++) {
+			uint16_t *n = &dfa->next[state * dfa->nclasses +
+						 dfa->class[(unsigned char)*c]];
+			if (*n == LEASE_DFA_DEAD) {
+				if (LEASE_DFA_STATES <= dfa->nstates)
+					abort();
+				*n = dfa->nstates++;
+			}
+			state = *n;
+		}
+		dfa->accept[state] = k->type;
+		length[k->type] = c - k->prefix;
+	}
+}
+
+/*! \brief Run lease file statement recognizer.  None of the keywords is
+ * prefix of another, so the first accepting state is the answer.
+ * \param dfa The automaton.
+ * \param str A line from dhcpd.leases
+ * \param len Length of the line
+ * \return prefix_t enum value */
+static inline int run_lease_dfa(const struct lease_dfa *restrict dfa,
+				const char *restrict str, const size_t len)
+{
+	const uint16_t *next = dfa->next;
+	const size_t nclasses = dfa->nclasses;
+	unsigned int state = LEASE_DFA_START;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		state = next[state * nclasses + dfa->class[(unsigned char)str[i]]];
+		if (state == LEASE_DFA_DEAD)
+			break;
+		if (dfa->accept[state] != NUM_OF_PREFIX)
+			return dfa->accept[state];
+	}
+	return NUM_OF_PREFIX;
+}
+
+/*! \brief Generate the lease file lexers for both IP versions.  The
+ * prefix_length array is filled as a side effect. */
+void prepare_lease_lexer(void)
+{
+	build_lease_dfa(&lease_dfa[0], lease_keywords_v4, prefix_length[0]);
+	build_lease_dfa(&lease_dfa[1], lease_keywords_v6, prefix_length[1]);
+}
+
+/*! \fn xstrstr_init(const char *restrict str, const size_t len)
+ * \brief Determine if the dhcpd is in IPv4 or IPv6 mode. This function
+ * may be needed when dhcpd.conf file has zero IP version hints.
+ *
+ * \param str A line from dhcpd.leases
+ * \param len Length of the line
+ * \return prefix_t enum value
+ */
+int xstrstr_init(const char *restrict str, const size_t len)
+{
+	if (len < 6 || memcmp("lease ", str, 6)) {
+		set_ipv_functions(IPv4);
+		return PREFIX_LEASE;
+	} else if (len < 9 || memcmp("  iaaddr ", str, 9)) {
+		set_ipv_functions(IPv6);
+		return PREFIX_LEASE;
+	}
+	return NUM_OF_PREFIX;
+}
+
+/*! \fn xstrstr_v4(const char *restrict str, const size_t len)
+ * \brief parse lease file in IPv4 mode
+ *
+ * \param str A line from dhcpd.leases
+ * \param len Length of the line
+ * \return prefix_t enum value
+ */
+int xstrstr_v4(const char *restrict str, const size_t len)
+{
+	return run_lease_dfa(&lease_dfa[0], str, len);
+}
+
+/*! \fn xstrstr_v6(const char *restrict str, const size_t len)
+ * \brief parse lease file in IPv6 mode
+ *
+ * \param str A line from dhcpd.leases
+ * \param len Length of the line
+ * \return prefix_t enum value
+ */
+int xstrstr_v6(const char *restrict str, const size_t len)
+{
+	return run_lease_dfa(&lease_dfa[1], str, len);
+}
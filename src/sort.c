@@ -63,41 +63,12 @@ int ipcomp_init(const union ipaddr_t *restrict a __attribute__ ((unused)),
 
 int ipcomp_v4(const union ipaddr_t *restrict a, const union ipaddr_t *restrict b)
 {
-	if (a->v4 < b->v4)
-		return -1;
-	if (a->v4 > b->v4)
-		return 1;
-	return 0;
+	return ip_cmp(IPv4, a, b);
 }
 
 int ipcomp_v6(const union ipaddr_t *restrict a, const union ipaddr_t *restrict b)
 {
-	return memcmp(&a->v6, &b->v6, sizeof(a->v6));
-}
-
-/*! \brief Compare IP address in leases_t structure, with IPv4/v6 determination.
- * \param a Binary IP address.
- * \param b Binary IP address.
- * \return If a < b return -1, if a < b return 1, when they are equal return 0.
- */
-int leasecomp_init(const struct leases_t *restrict a __attribute__ ((unused)),
-		   const struct leases_t *restrict b __attribute__ ((unused)))
-{
-	return 0;
-}
-
-int leasecomp_v4(const struct leases_t *restrict a, const struct leases_t *restrict b)
-{
-	if (a->ip.v4 < b->ip.v4)
-		return -1;
-	if (a->ip.v4 > b->ip.v4)
-		return 1;
-	return 0;
-}
-
-int leasecomp_v6(const struct leases_t *restrict a, const struct leases_t *restrict b)
-{
-	return memcmp(&a->ip.v6, &b->ip.v6, sizeof(a->ip.v6));
+	return ip_cmp(IPv6, a, b);
 }
 
 /*! \brief Compare IP address in leases. Suitable for sorting range table.
@@ -258,8 +229,9 @@ static int merge(struct range_t *restrict left, struct range_t *restrict right)
 
 	for (p = config.sorts; p; p = p->next) {
 		if (p->func == NULL) {
-			/* String sorting is special. */
-			ret = strcmp(left->shared_net->name, right->shared_net->name);
+			/* Names are ranked by rank_shared_network_names(). */
+			ret = (left->shared_net->name_id > right->shared_net->name_id)
+			    - (left->shared_net->name_id < right->shared_net->name_id);
 		} else {
 			/* Range sorts are common. */
 			ret = p->func(left, right);
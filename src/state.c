@@ -0,0 +1,220 @@
+/*
+ * The dhcpd-pools has BSD 2-clause license which also known as "Simplified
+ * BSD License" or "FreeBSD License".
+ *
+ * Copyright 2006- Sami Kerola. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the
+ *       distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR AND CONTRIBUTORS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing
+ * official policies, either expressed or implied, of Sami Kerola.
+ */
+
+/*! \file state.c
+ * \brief Lease table checkpoint.  The lease file is appended by dhcpd
+ * between rewrites, so the lease table of a previous run together with
+ * the position where that run stopped lets the next run parse only the
+ * new records.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "close-stream.h"
+#include "error.h"
+#include "xalloc.h"
+
+#include "dhcpd-pools.h"
+#include "defaults.h"
+
+/*! \def STATE_MAGIC
+ * \brief Identifier and format version of a state file.  */
+#define STATE_MAGIC "dpstate1"
+
+/*! \def STATE_TAIL
+ * \brief Number of lease file bytes before the saved position that are
+ * compared, in order to notice a file rewritten in place.  */
+#define STATE_TAIL 256
+
+/*! \struct state_header
+ * \brief Beginning of a state file.  The header is followed by
+ * num_leases state_lease records, each followed by ethernet_len bytes of
+ * hardware address.
+ */
+struct state_header {
+	char magic[8];
+	uint32_t ip_version;
+	uint32_t print_mac_addreses;
+	uint32_t backups_found;
+	uint32_t tail_len;
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	uint64_t mtime;
+	uint64_t offset;
+	uint64_t num_leases;
+	union ipaddr_t addr;
+	char tail[STATE_TAIL];
+};
+
+/*! \struct state_lease
+ * \brief A lease in a state file.
+ */
+struct state_lease {
+	union ipaddr_t ip;
+	uint8_t type;
+	uint8_t ethernet_len;
+};
+
+/*! \brief Read lease table of a previous run from config.state_file.
+ * Nothing is loaded if the state file is missing, broken, or does not
+ * match with the lease file.
+ * \param st Status of the lease file.
+ * \param map The lease file contents.
+ * \param size Size of the lease file.
+ * \param addr Output of the lease address in effect at the saved position.
+ * \param backups_found Output of backup state being seen.
+ * \return Position in lease file where parsing should continue, zero
+ * when the whole file needs to be parsed. */
+size_t load_lease_state(const struct stat *st, const char *map, const size_t size,
+			union ipaddr_t *addr, unsigned int *backups_found)
+{
+	FILE *f;
+	struct state_header h;
+	struct state_lease sl;
+	struct leases_t *l;
+	char ethernet[UINT8_MAX];
+	uint64_t i;
+
+	f = fopen(config.state_file, "r");
+	if (f == NULL)
+		return 0;
+	if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, STATE_MAGIC, sizeof(h.magic))
+	    || h.dev != (uint64_t)st->st_dev || h.ino != (uint64_t)st->st_ino
+	    || size < h.size || h.size < h.offset || STATE_TAIL < h.tail_len
+	    || (h.size == size && h.mtime != (uint64_t)st->st_mtime)
+	    || h.offset < h.tail_len
+	    || memcmp(map + h.offset - h.tail_len, h.tail, h.tail_len)
+	    || (h.ip_version != IPv4 && h.ip_version != IPv6)
+	    || (config.ip_version != IPvUNKNOWN && config.ip_version != h.ip_version)
+	    || (config.print_mac_addreses && !h.print_mac_addreses)) {
+		fclose(f);
+		return 0;
+	}
+	if (config.ip_version == IPvUNKNOWN)
+		set_ipv_functions(h.ip_version);
+	for (i = 0; i < h.num_leases; i++) {
+		if (fread(&sl, sizeof(sl), 1, f) != 1 || NOSTATE <= sl.type)
+			goto broken;
+		l = add_lease(&leases, &sl.ip, sl.type);
+		if (sl.ethernet_len == 0)
+			continue;
+		if (fread(ethernet, sl.ethernet_len, 1, f) != 1)
+			goto broken;
+		set_lease_ethernet(&leases, l, ethernet, sl.ethernet_len);
+	}
+	fclose(f);
+	copy_ipaddr(addr, &h.addr);
+	*backups_found = h.backups_found;
+	return h.offset;
+ broken:
+	fclose(f);
+	delete_all_leases();
+	return 0;
+}
+
+/*! \brief Write lease table to config.state_file.  The file is written
+ * to a temporary name and renamed, so that an interrupted run does not
+ * leave a partial state behind.  Failures are reported, but they are not
+ * fatal.
+ * \param st Status of the lease file.
+ * \param map The lease file contents.
+ * \param size Size of the lease file.
+ * \param addr The lease address in effect at the end of the file.
+ * \param backups_found Backup state was seen. */
+void save_lease_state(const struct stat *st, const char *map, const size_t size,
+		      const union ipaddr_t *addr, const unsigned int backups_found)
+{
+	FILE *f;
+	char *tmp;
+	struct state_header h;
+	struct state_lease sl;
+	struct leases_t *l;
+	char mac[MAC_STRING_LEN + 1];
+	const char *nl, *ethernet;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, STATE_MAGIC, sizeof(h.magic));
+	h.ip_version = config.ip_version;
+	h.print_mac_addreses = config.print_mac_addreses;
+	h.backups_found = backups_found;
+	h.dev = st->st_dev;
+	h.ino = st->st_ino;
+	h.size = size;
+	h.mtime = st->st_mtime;
+	/* an incomplete last line is parsed again next time */
+	nl = memrchr(map, '\n', size);
+	h.offset = nl ? (size_t)(nl - map + 1) : 0;
+	h.tail_len = h.offset < STATE_TAIL ? h.offset : STATE_TAIL;
+	memcpy(h.tail, map + h.offset - h.tail_len, h.tail_len);
+	copy_ipaddr(&h.addr, addr);
+	h.num_leases = leases.count;
+
+	tmp = xmalloc(strlen(config.state_file) + 5);
+	sprintf(tmp, "%s.tmp", config.state_file);
+	f = fopen(tmp, "w");
+	if (f == NULL) {
+		error(0, errno, "save_lease_state: %s", tmp);
+		free(tmp);
+		return;
+	}
+	fwrite(&h, sizeof(h), 1, f);
+	for (l = leases.slots; l < leases.slots + leases.size; l++) {
+		if (!l->in_use)
+			continue;
+		memset(&sl, 0, sizeof(sl));
+		copy_ipaddr(&sl.ip, &l->ip);
+		sl.type = l->type;
+		ethernet = lease_ethernet(&leases, l, mac);
+		sl.ethernet_len = strlen(ethernet);
+		fwrite(&sl, sizeof(sl), 1, f);
+		if (sl.ethernet_len)
+			fwrite(ethernet, sl.ethernet_len, 1, f);
+	}
+	if (close_stream(f)) {
+		error(0, errno, "save_lease_state: %s", tmp);
+		unlink(tmp);
+	} else if (rename(tmp, config.state_file))
+		error(0, errno, "save_lease_state: %s", config.state_file);
+	free(tmp);
+}
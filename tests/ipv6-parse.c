@@ -0,0 +1,119 @@
+/*
+ * The dhcpd-pools has BSD 2-clause license which also known as "Simplified
+ * BSD License" or "FreeBSD License".
+ *
+ * Copyright 2006- Sami Kerola. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the
+ *       distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR AND CONTRIBUTORS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing
+ * official policies, either expressed or implied, of Sami Kerola.
+ */
+
+/*
+ * Differential test of parse_ipv6() against inet_pton(AF_INET6).  Both
+ * random strings built from address characters and well formed addresses
+ * with random compression, leading zeros and embedded IPv4 are tried.
+ */
+
+#include <config.h>
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dhcpd-pools.h"
+
+/* Number of test cases. */
+#define ROUNDS 2000000
+
+static uint32_t seed = 2463534242U;
+
+static uint32_t rnd(const uint32_t n)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed % n;
+}
+
+static void random_string(char *s)
+{
+	static const char chars[] = "0123456789abcdefABCDEF::::....x ";
+	int i, len = rnd(46);
+
+	for (i = 0; i < len; i++)
+		s[i] = chars[rnd(sizeof(chars) - 1)];
+	s[len] = '\0';
+}
+
+static void random_address(char *s)
+{
+	int i, groups = rnd(9), compress = rnd(groups + 2), v4 = rnd(4) == 0;
+
+	s[0] = '\0';
+	for (i = 0; i < groups; i++) {
+		if (i == compress)
+			strcat(s, "::");
+		else if (i)
+			strcat(s, ":");
+		sprintf(s + strlen(s), rnd(5) ? "%x" : "%04X", rnd(0x10000) >> (rnd(4) * 4));
+	}
+	if (compress == groups)
+		strcat(s, "::");
+	if (v4) {
+		if (s[0] && s[strlen(s) - 1] != ':')
+			strcat(s, ":");
+		sprintf(s + strlen(s), rnd(8) ? "%u.%u.%u.%u" : "%03u.%u.%u.%u",
+			rnd(260), rnd(256), rnd(256), rnd(256));
+	}
+}
+
+int main(void)
+{
+	char s[128];
+	unsigned char want[16], got[16];
+	int i, rv_want, rv_got;
+
+	for (i = 0; i < ROUNDS; i++) {
+		if (i % 2)
+			random_string(s);
+		else
+			random_address(s);
+		memset(want, 0, sizeof(want));
+		memset(got, 0, sizeof(got));
+		rv_want = inet_pton(AF_INET6, s, want) == 1;
+		rv_got = parse_ipv6(s, strlen(s), got);
+		if (rv_want != rv_got || (rv_want && memcmp(want, got, sizeof(want)))) {
+			fprintf(stderr, "ipv6-parse: mismatch on '%s': inet_pton %d parse_ipv6 %d\n",
+				s, rv_want, rv_got);
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}